@@ -0,0 +1,60 @@
+#!/usr/bin/env python3
+# Combine the per-node Chrome traces written by a PARTEXCHANGE_TRACE build
+# into one file for chrome://tracing or Perfetto.
+#
+#   merge_traces.py [-o merged.json] trace.0.json trace.1.json ...
+#
+# Node n keeps process id n. Ring buffers that wrapped start part way
+# through a scope, so end events with no begin on their thread are dropped.
+
+import argparse
+import json
+import sys
+
+
+def matched_events(events):
+    depth = {}
+    kept = []
+    for event in events:
+        key = (event.get("pid"), event.get("tid"))
+        phase = event.get("ph")
+        if phase == "B":
+            depth[key] = depth.get(key, 0) + 1
+        elif phase == "E":
+            if depth.get(key, 0) == 0:
+                continue
+            depth[key] -= 1
+        kept.append(event)
+    return kept
+
+
+def main():
+    parser = argparse.ArgumentParser(description="Merge per-node PartExchange traces")
+    parser.add_argument("traces", nargs="+", help="per-node trace files")
+    parser.add_argument("-o", "--output", default="trace.json", help="merged trace file")
+    args = parser.parse_args()
+
+    metadata = []
+    events = []
+    for name in args.traces:
+        with open(name) as f:
+            trace = json.load(f)
+        for event in trace["traceEvents"]:
+            if event.get("ph") == "M":
+                metadata.append(event)
+            else:
+                events.append(event)
+
+    # Stable, so events of a thread with equal timestamps keep their order
+    events.sort(key=lambda event: event["ts"])
+    events = matched_events(events)
+
+    with open(args.output, "w") as f:
+        json.dump({"displayTimeUnit": "ns", "traceEvents": metadata + events}, f)
+
+    print("Merged {} events from {} traces into {}".format(len(events), len(args.traces), args.output))
+    return 0
+
+
+if __name__ == "__main__":
+    sys.exit(main())
@@ -0,0 +1,384 @@
+#include "Checkpoint.hpp"
+#include "ParticleMover.hpp"
+#include "TileMap.hpp"
+
+#include <fstream>
+#include <iostream>
+#include <algorithm>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <fmt/format.h>
+#include <mpi.h>
+#include <cstdio>
+
+constexpr uint64_t CheckpointHeader::magic_value;
+constexpr uint32_t CheckpointHeader::current_version;
+
+// Particle arrays start on a cache line, so mapped files can be read in place
+static constexpr uint64_t particle_alignment = 64;
+
+static uint64_t alignUp(const uint64_t offset) {
+  return (offset + particle_alignment - 1) / particle_alignment * particle_alignment;
+}
+
+static std::string nodeFile(const std::string& path, const int node) {
+  return path + ".r" + std::to_string(node);
+}
+
+std::string checkpointPath(const std::string& prefix, const int next_step) {
+  return prefix + ".s" + std::to_string(next_step);
+}
+
+// Whether [offset, offset + length) lies inside a file of the given size
+static bool inside(const uint64_t offset, const uint64_t length, const uint64_t bytes) {
+  return offset <= bytes && length <= bytes - offset;
+}
+
+static bool readAt(const int fd, void* buf, const std::size_t bytes, const uint64_t offset) {
+  std::size_t done = 0;
+  while(done < bytes) {
+    const ssize_t got = pread(fd, static_cast<char*>(buf) + done, bytes - done, offset + done);
+    if(got <= 0)
+      return false;
+    done += got;
+  }
+
+  return true;
+}
+
+// Read one file's header and tile table, checking that the table and all
+// it points at lie inside the file. Returns why the file can't be used,
+// or an empty string
+static std::string readTable(const std::string& fname, CheckpointHeader& file_header,
+  std::vector<CheckpointTileEntry>& entries, uint64_t& bytes) {
+  const int fd = ::open(fname.c_str(), O_RDONLY);
+  if(fd < 0)
+    return "could not be opened";
+
+  struct stat st;
+  bool readable = fstat(fd, &st) == 0;
+  bytes = readable ? st.st_size : 0;
+  readable = readable && inside(0, sizeof(CheckpointHeader), bytes) && readAt(fd, &file_header, sizeof(CheckpointHeader), 0);
+
+  const bool good_header = readable && file_header.magic == CheckpointHeader::magic_value
+    && file_header.version == CheckpointHeader::current_version && file_header.particle_bytes == sizeof(Particle)
+    && file_header.ntiles > 0 && file_header.nnodes > 0
+    && file_header.num_entries >= 0 && file_header.num_entries <= file_header.ntiles;
+
+  const uint64_t table_bytes = good_header ? static_cast<uint64_t>(file_header.num_entries) * sizeof(CheckpointTileEntry) : 0;
+  const bool good_table = good_header && inside(sizeof(CheckpointHeader), table_bytes, bytes);
+  if(good_table) {
+    entries.resize(file_header.num_entries);
+    readable = readAt(fd, entries.data(), table_bytes, sizeof(CheckpointHeader));
+  }
+  ::close(fd);
+
+  if(!readable)
+    return "is truncated or unreadable";
+  if(file_header.magic != CheckpointHeader::magic_value || file_header.version != CheckpointHeader::current_version)
+    return fmt::format("is not a version {} checkpoint file", CheckpointHeader::current_version);
+  if(file_header.particle_bytes != sizeof(Particle))
+    return fmt::format("holds {} byte particles, this executable uses {}", file_header.particle_bytes, sizeof(Particle));
+  if(!good_header)
+    return "has a bad header";
+  if(!good_table)
+    return "is truncated in its tile table";
+
+  for(auto& entry : entries) {
+    const uint64_t particle_bytes = static_cast<uint64_t>(std::max(entry.num_particles, 0)) * sizeof(Particle);
+    const bool good_entry = entry.num_particles >= 0 && entry.particles_offset % alignof(Particle) == 0
+      && inside(entry.engines_offset, entry.engines_bytes, bytes)
+      && inside(entry.particles_offset, particle_bytes, bytes);
+    if(!good_entry)
+      return fmt::format("is truncated or corrupt in the data of tile {}", entry.tile);
+  }
+
+  return "";
+}
+
+// Map a whole file read only, checking it is still the size node 0 saw
+static bool mapFile(const std::string& fname, const uint64_t bytes, const char*& data) {
+  const int fd = ::open(fname.c_str(), O_RDONLY);
+  if(fd < 0)
+    return false;
+
+  struct stat st;
+  if(fstat(fd, &st) == 0 && static_cast<uint64_t>(st.st_size) == bytes) {
+    void* mapped = mmap(nullptr, bytes, PROT_READ, MAP_PRIVATE, fd, 0);
+    if(mapped != MAP_FAILED)
+      data = static_cast<const char*>(mapped);
+  }
+  ::close(fd);
+
+  return data != nullptr;
+}
+
+// Whether a node's part of the checkpoint succeeded
+struct CheckpointVoteMsg : vt::Message {
+  CheckpointVoteMsg() = default;
+  explicit CheckpointVoteMsg(bool in_ok) : ok(in_ok) {}
+
+  bool ok = false;
+};
+
+// Node 0's count of the votes on the checkpoint being written
+struct CheckpointTally {
+  int written = 0;
+  int renamed = 0;
+  bool all_written = true;
+  bool all_renamed = true;
+};
+
+static CheckpointTally tally;
+
+// This node's file of the checkpoint being written
+static std::string pending_file;
+
+static void checkpointRenamedHandler(CheckpointVoteMsg* msg) {
+  tally.renamed++;
+  tally.all_renamed = tally.all_renamed && msg->ok;
+}
+
+static void checkpointCommitHandler(CheckpointVoteMsg* msg) {
+  const std::string tmp_name = pending_file + ".tmp";
+  bool renamed = false;
+  if(msg->ok)
+    renamed = std::rename(tmp_name.c_str(), pending_file.c_str()) == 0;
+  else
+    std::remove(tmp_name.c_str());
+
+  auto reply = vt::makeSharedMessage<CheckpointVoteMsg>(renamed);
+  vt::theMsg()->sendMsg<CheckpointVoteMsg, checkpointRenamedHandler>(0, reply);
+}
+
+// Only rename once every node has its file, so a checkpoint is either
+// complete or missing
+static void checkpointWrittenHandler(CheckpointVoteMsg* msg) {
+  tally.written++;
+  tally.all_written = tally.all_written && msg->ok;
+
+  const int nnodes = vt::theContext()->getNumNodes();
+  if(tally.written < nnodes)
+    return;
+
+  for(int node = 0; node < nnodes; node++) {
+    auto commit = vt::makeSharedMessage<CheckpointVoteMsg>(tally.all_written);
+    vt::theMsg()->sendMsg<CheckpointVoteMsg, checkpointCommitHandler>(node, commit);
+  }
+}
+
+bool takeCheckpointResult() {
+  const bool complete = tally.written == vt::theContext()->getNumNodes() && tally.all_written
+    && tally.renamed == tally.written && tally.all_renamed;
+  tally = CheckpointTally();
+  return complete;
+}
+
+void startCheckpoint(const std::string& path, const int next_step, PMProxyType& proxy, const vt::EpochType epoch) {
+  const vt::NodeType me = vt::theContext()->getNode();
+
+  // Tiles are at rest between steps, so TileMap is exact
+  std::vector<ParticleMover*> tiles;
+  std::vector<TileState> states;
+  for(auto& tile : TileMap::localTiles(me)) {
+    auto local = proxy[tile].tryGetLocalPtr();
+    vtAssert(local != nullptr, "Checkpoint needs every tile on the node TileMap places it on");
+
+    tiles.push_back(local);
+    states.push_back(local->saveState());
+  }
+
+  CheckpointHeader header;
+  header.next_step = next_step;
+  header.ntiles = TileMap::numTiles();
+  header.nnodes = vt::theContext()->getNumNodes();
+  header.num_entries = tiles.size();
+
+  // Lay out the engine states after the table, then the particle arrays
+  std::vector<CheckpointTileEntry> entries(tiles.size());
+  uint64_t offset = sizeof(CheckpointHeader) + entries.size() * sizeof(CheckpointTileEntry);
+  for(int i = 0; i < tiles.size(); i++) {
+    entries[i].tile = states[i].tile;
+    entries[i].num_particles = tiles[i]->size();
+    entries[i].total_seconds = states[i].total_seconds;
+    entries[i].engines_offset = offset;
+    entries[i].engines_bytes = states[i].engines.size();
+    offset += entries[i].engines_bytes;
+  }
+  for(int i = 0; i < tiles.size(); i++) {
+    offset = alignUp(offset);
+    entries[i].particles_offset = offset;
+    offset += static_cast<uint64_t>(entries[i].num_particles) * sizeof(Particle);
+  }
+
+  // Written under a temporary name, so an interrupted write never leaves
+  // a file that looks complete
+  const std::string fname = nodeFile(path, me);
+  const std::string tmp_name = fname + ".tmp";
+  std::ofstream out(tmp_name, std::ios::binary | std::ios::trunc);
+
+  out.write(reinterpret_cast<const char*>(&header), sizeof(header));
+  out.write(reinterpret_cast<const char*>(entries.data()), entries.size() * sizeof(CheckpointTileEntry));
+  for(auto& state : states)
+    out.write(state.engines.data(), state.engines.size());
+
+  const char zeros[particle_alignment] = {};
+  for(int i = 0; i < tiles.size(); i++) {
+    const uint64_t pos = out.tellp();
+    out.write(zeros, entries[i].particles_offset - pos);
+    tiles[i]->writeParticles(out);
+  }
+
+  out.close();
+  pending_file = fname;
+
+  auto vote = vt::makeSharedMessage<CheckpointVoteMsg>(!out.fail());
+  vt::envelopeSetEpoch(vote->env, epoch);
+  vt::theMsg()->sendMsg<CheckpointVoteMsg, checkpointWrittenHandler>(0, vote);
+}
+
+bool CheckpointReader::readTables(const std::string& path) {
+  for(int node = 0; node == 0 || node < header.nnodes; node++) {
+    const std::string fname = nodeFile(path, node);
+
+    CheckpointHeader file_header;
+    std::vector<CheckpointTileEntry> entries;
+    uint64_t bytes = 0;
+
+    const std::string error = readTable(fname, file_header, entries, bytes);
+    if(!error.empty()) {
+      fmt::print("Checkpoint file {} {}\n", fname, error);
+      return false;
+    }
+
+    if(node == 0) {
+      header = file_header;
+      records.assign(header.ntiles, TileRecord());
+      file_bytes.assign(header.nnodes, 0);
+    } else if(file_header.next_step != header.next_step || file_header.ntiles != header.ntiles || file_header.nnodes != header.nnodes) {
+      fmt::print("Checkpoint file {} belongs to a different checkpoint\n", fname);
+      return false;
+    }
+    file_bytes[node] = bytes;
+
+    for(auto& entry : entries) {
+      if(entry.tile < 0 || entry.tile >= header.ntiles || records[entry.tile].file >= 0) {
+        fmt::print("Checkpoint file {} has a bad or repeated tile {}\n", fname, entry.tile);
+        return false;
+      }
+      records[entry.tile].file = node;
+      records[entry.tile].entry = entry;
+    }
+  }
+
+  for(int tile = 0; tile < header.ntiles; tile++) {
+    if(records[tile].file < 0) {
+      fmt::print("Checkpoint {} has no tile {}\n", path, tile);
+      return false;
+    }
+  }
+
+  return true;
+}
+
+bool CheckpointReader::open(const std::string& path, const int ntiles, const std::vector<int>& local_tiles) {
+  const vt::NodeType me = vt::theContext()->getNode();
+
+  int ok = me == 0 ? readTables(path) : 1;
+  MPI_Bcast(&ok, 1, MPI_INT, 0, MPI_COMM_WORLD);
+  if(!ok)
+    return false;
+
+  // Every node gets the tables node 0 checked
+  MPI_Bcast(&header, sizeof(CheckpointHeader), MPI_BYTE, 0, MPI_COMM_WORLD);
+  file_bytes.resize(header.nnodes);
+  records.resize(header.ntiles);
+  MPI_Bcast(file_bytes.data(), header.nnodes, MPI_UINT64_T, 0, MPI_COMM_WORLD);
+  MPI_Bcast(records.data(), header.ntiles * sizeof(TileRecord), MPI_BYTE, 0, MPI_COMM_WORLD);
+
+  tile_starts.assign(1, 0);
+  for(auto& record : records)
+    tile_starts.push_back(tile_starts.back() + record.entry.num_particles);
+
+  // Map only the files holding this node's particles
+  files.resize(header.nnodes);
+  for(auto& tile : local_tiles) {
+    const auto sources = sourceTiles(tile, ntiles);
+    for(int old_tile = sources.first; old_tile < sources.second && ok; old_tile++) {
+      const int node = records[old_tile].file;
+      if(files[node].data != nullptr)
+        continue;
+
+      const std::string fname = nodeFile(path, node);
+      if(mapFile(fname, file_bytes[node], files[node].data)) {
+        files[node].bytes = file_bytes[node];
+      } else {
+        fmt::print("Node {} could not map checkpoint file {}\n", me, fname);
+        ok = 0;
+      }
+    }
+  }
+
+  MPI_Allreduce(MPI_IN_PLACE, &ok, 1, MPI_INT, MPI_MIN, MPI_COMM_WORLD);
+  return ok;
+}
+
+CheckpointReader::~CheckpointReader() {
+  for(auto& file : files) {
+    if(file.data != nullptr)
+      munmap(const_cast<char*>(file.data), file.bytes);
+  }
+}
+
+std::pair<long, long> CheckpointReader::particleRange(const int tile, const int ntiles) const {
+  const long total = numParticles();
+  return {total * tile / ntiles, total * (tile + 1) / ntiles};
+}
+
+std::pair<int, int> CheckpointReader::sourceTiles(const int tile, const int ntiles) const {
+  if(ntiles == header.ntiles)
+    return {tile, tile + 1};
+
+  const auto range = particleRange(tile, ntiles);
+  if(range.first == range.second)
+    return {0, 0};
+
+  // Old tile i holds particles [tile_starts[i], tile_starts[i+1])
+  const int first = std::upper_bound(tile_starts.begin(), tile_starts.end(), range.first) - tile_starts.begin() - 1;
+  const int last = std::lower_bound(tile_starts.begin(), tile_starts.end(), range.second) - tile_starts.begin();
+  return {first, last};
+}
+
+const Particle* CheckpointReader::tileParticles(const TileRecord& record) const {
+  return reinterpret_cast<const Particle*>(files[record.file].data + record.entry.particles_offset);
+}
+
+void CheckpointReader::restoreTile(const int tile, const int ntiles, ParticleMover& mover) const {
+  if(ntiles == header.ntiles) {
+    const auto& record = records[tile];
+    const auto& entry = record.entry;
+
+    TileState state;
+    state.tile = tile;
+    state.total_seconds = entry.total_seconds;
+    state.engines.assign(files[record.file].data + entry.engines_offset, entry.engines_bytes);
+
+    mover.restoreState(header.next_step, state);
+    mover.restoreParticles(tileParticles(record), entry.num_particles);
+    return;
+  }
+
+  // Even split of the particles, in old tile order, over the new tiles
+  mover.restoreState(header.next_step, TileState());
+
+  const auto range = particleRange(tile, ntiles);
+  const auto sources = sourceTiles(tile, ntiles);
+  for(int old_tile = sources.first; old_tile < sources.second; old_tile++) {
+    const long from = std::max(range.first, tile_starts[old_tile]);
+    const long to = std::min(range.second, tile_starts[old_tile + 1]);
+    if(to > from)
+      mover.restoreParticles(tileParticles(records[old_tile]) + (from - tile_starts[old_tile]), to - from);
+  }
+}
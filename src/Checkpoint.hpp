@@ -0,0 +1,126 @@
+#ifndef CHECKPOINT_HPP
+#define CHECKPOINT_HPP
+#include "Particle.hpp"
+
+#include <vt/transport.h>
+#include <cstdint>
+#include <string>
+#include <vector>
+#include <utility>
+
+class ParticleMover;
+using IndexType = vt::IdxType1D<std::size_t>;
+using PMProxyType = vt::vrt::collection::CollectionProxy<ParticleMover, IndexType>;
+
+// Binary checkpoints, one file per node. A checkpoint taken before step s
+// lives in <prefix>.s<s>.r<node> and holds, in native byte order:
+//   CheckpointHeader
+//   CheckpointTileEntry for each tile written by the node
+//   each tile's engine states, then each tile's particles, 64 byte aligned
+// Each file is written under a .tmp name and renamed once every node has
+// written its own. On restart node 0 reads and checks the headers and
+// tile tables and broadcasts them, and every node maps only the files
+// holding particles it needs. The neighbour graph is not stored; it is
+// regenerated from the input deck
+
+struct CheckpointHeader {
+  static constexpr uint64_t magic_value = 0x54504b4358455450ull;   // "PTEXCKPT"
+  static constexpr uint32_t current_version = 1;
+
+  uint64_t magic = magic_value;
+  uint32_t version = current_version;
+  uint32_t particle_bytes = sizeof(Particle);
+  int32_t next_step = 0;    // first step to run after a restart
+  int32_t ntiles = 0;       // tiles in the whole run
+  int32_t nnodes = 0;       // nodes, and so files, in the checkpoint
+  int32_t num_entries = 0;  // tiles in this file
+};
+
+struct CheckpointTileEntry {
+  int32_t tile = 0;
+  int32_t num_particles = 0;
+  double total_seconds = 0.;
+  uint64_t engines_offset = 0;
+  uint64_t engines_bytes = 0;
+  uint64_t particles_offset = 0;
+};
+
+struct CheckpointConfig {
+  int interval = 0;                    // steps between checkpoints, 0 for none
+  std::string prefix = "checkpoint";
+  std::string restart;                 // checkpoint path to restart from
+};
+
+// What a tile saves besides its particles
+struct TileState {
+  int tile = 0;
+  double total_seconds = 0.;
+  std::string engines;   // textual engine states, empty to reseed
+};
+
+// <prefix>.s<next_step>, the path shared by the files of a checkpoint
+std::string checkpointPath(const std::string& prefix, const int next_step);
+
+// Write this node's file of the checkpoint taken before next_step, then
+// agree on it with vt messages in epoch: every node tells node 0 whether
+// its file was written, and node 0 tells every node to rename or remove
+// it. Called on every node between steps, while the tiles are quiescent
+void startCheckpoint(const std::string& path, const int next_step, PMProxyType& proxy, vt::EpochType epoch);
+
+// Node 0, once the epoch of startCheckpoint has terminated: whether every
+// node's file was written and renamed
+bool takeCheckpointResult();
+
+// The tile tables of a checkpoint, and the files this node needs, mapped
+// read only
+class CheckpointReader {
+  public:
+    // Collective. Check the checkpoint and map the files holding the
+    // particles of local_tiles, in a run with ntiles tiles. Returns false
+    // on every node, after printing why, if the checkpoint can't be used
+    bool open(const std::string& path, const int ntiles, const std::vector<int>& local_tiles);
+
+    ~CheckpointReader();
+
+    int nextStep() const { return header.next_step; }
+    int numTiles() const { return header.ntiles; }
+    long numParticles() const { return tile_starts.back(); }
+
+    // Give a tile of a run with ntiles tiles its particles. With the tile
+    // count unchanged the tile is restored exactly, engines included.
+    // Otherwise the particles, in old tile order, are split evenly over
+    // the new tiles, which keep their fresh engines
+    void restoreTile(const int tile, const int ntiles, ParticleMover& mover) const;
+
+  private:
+    struct MappedFile {
+      const char* data = nullptr;
+      std::size_t bytes = 0;
+    };
+
+    // Where each old tile's data is, in tile order
+    struct TileRecord {
+      int file = -1;
+      CheckpointTileEntry entry;
+    };
+
+    // Node 0: read and check every file's header and tile table
+    bool readTables(const std::string& path);
+
+    // Particles [first, last), in old tile order, of a new tile when the
+    // tile count changes
+    std::pair<long, long> particleRange(const int tile, const int ntiles) const;
+
+    // Old tiles [first, last) holding the particles of a new tile
+    std::pair<int, int> sourceTiles(const int tile, const int ntiles) const;
+
+    const Particle* tileParticles(const TileRecord& record) const;
+
+    CheckpointHeader header;
+    std::vector<uint64_t> file_bytes;   // size of each node's file
+    std::vector<MappedFile> files;      // mapped on this node, or null
+    std::vector<TileRecord> records;
+    std::vector<long> tile_starts;      // prefix sum of particle counts
+};
+
+#endif
@@ -0,0 +1,194 @@
+#ifndef COUNTER_RNG_HPP
+#define COUNTER_RNG_HPP
+#include <cstdint>
+#include <vector>
+#include <cmath>
+#include <algorithm>
+
+// Stateless random number helpers. Every value is a pure function of its
+// key and counter, so any rank can reproduce any draw without having
+// generated the ones before it
+
+// SplitMix64 finaliser, a cheap bijective 64 bit mix
+inline uint64_t hashMix(uint64_t x) {
+  x += 0x9e3779b97f4a7c15ULL;
+  x = (x ^ (x >> 30)) * 0xbf58476d1ce4e5b9ULL;
+  x = (x ^ (x >> 27)) * 0x94d049bb133111ebULL;
+  return x ^ (x >> 31);
+}
+
+inline uint64_t hashCombine(const uint64_t key, const uint64_t value) {
+  return hashMix(key ^ hashMix(value));
+}
+
+// Uniform double in [0, 1) from a hash value
+inline double hashToUnit(const uint64_t h) {
+  return (h >> 11) * (1.0 / 9007199254740992.0);
+}
+
+// Keyed pseudorandom permutation of [0, n), built from a balanced Feistel
+// network over the next even power of two with cycle walking back into
+// range. Both directions cost a handful of hashes
+class HashPermutation {
+  public:
+    HashPermutation(const uint64_t n_, const uint64_t key_) : n(n_), key(key_) {
+      int bits = 0;
+      while(bits < 64 && (1ULL << bits) < n)
+        bits++;
+      half_bits = (bits + 1) / 2;
+      if(half_bits == 0)
+        half_bits = 1;
+      half_mask = (1ULL << half_bits) - 1;
+    }
+
+    uint64_t forward(uint64_t x) const {
+      do {
+        x = feistel(x);
+      } while(x >= n);
+      return x;
+    }
+
+    uint64_t inverse(uint64_t x) const {
+      do {
+        x = feistelInverse(x);
+      } while(x >= n);
+      return x;
+    }
+
+  private:
+    static constexpr int rounds = 4;
+
+    inline uint64_t roundFn(const int round, const uint64_t value) const {
+      return hashCombine(key + round, value) & half_mask;
+    }
+
+    uint64_t feistel(const uint64_t x) const {
+      uint64_t left = x >> half_bits;
+      uint64_t right = x & half_mask;
+      for(int r = 0; r < rounds; r++) {
+        const uint64_t next = left ^ roundFn(r, right);
+        left = right;
+        right = next;
+      }
+      return (left << half_bits) | right;
+    }
+
+    uint64_t feistelInverse(const uint64_t x) const {
+      uint64_t left = x >> half_bits;
+      uint64_t right = x & half_mask;
+      for(int r = rounds - 1; r >= 0; r--) {
+        const uint64_t prev = right ^ roundFn(r, left);
+        right = left;
+        left = prev;
+      }
+      return (left << half_bits) | right;
+    }
+
+    uint64_t n;
+    uint64_t key;
+    int half_bits;
+    uint64_t half_mask;
+};
+
+// Philox4x32-10 (Salmon et al., SC'11). Maps a 128 bit counter and a 64
+// bit key to 128 random bits with no state between calls, so draws can be
+// made in any order, on any thread, and in SIMD batches
+struct Philox4x32 {
+  static constexpr uint32_t mul0 = 0xD2511F53;
+  static constexpr uint32_t mul1 = 0xCD9E8D57;
+  static constexpr uint32_t weyl0 = 0x9E3779B9;
+  static constexpr uint32_t weyl1 = 0xBB67AE85;
+  static constexpr int rounds = 10;
+
+  static inline void generate(const uint32_t ctr[4], const uint32_t key[2], uint32_t out[4]) {
+    uint32_t x0 = ctr[0], x1 = ctr[1], x2 = ctr[2], x3 = ctr[3];
+    uint32_t k0 = key[0], k1 = key[1];
+
+    for(int r = 0; r < rounds; r++) {
+      const uint64_t p0 = static_cast<uint64_t>(mul0) * x0;
+      const uint64_t p1 = static_cast<uint64_t>(mul1) * x2;
+      const uint32_t hi0 = static_cast<uint32_t>(p0 >> 32), lo0 = static_cast<uint32_t>(p0);
+      const uint32_t hi1 = static_cast<uint32_t>(p1 >> 32), lo1 = static_cast<uint32_t>(p1);
+
+      x0 = hi1 ^ x1 ^ k0;
+      x1 = lo1;
+      x2 = hi0 ^ x3 ^ k1;
+      x3 = lo0;
+
+      k0 += weyl0;
+      k1 += weyl1;
+    }
+
+    out[0] = x0;
+    out[1] = x1;
+    out[2] = x2;
+    out[3] = x3;
+  }
+};
+
+// Uniform double in [0, 1) from 32 random bits
+inline double philoxToUnit(const uint32_t x) {
+  return x * (1.0 / 4294967296.0);
+}
+
+// Uniform integer in [0, n) from 32 random bits, by multiply and shift
+inline int philoxToRange(const uint32_t x, const int n) {
+  return static_cast<int>((static_cast<uint64_t>(x) * static_cast<uint32_t>(n)) >> 32);
+}
+
+// Inverse CDF sampling of a Poisson distribution from 32 random bits.
+// The CDF is tabulated once, as 32 bit thresholds, over a window of about
+// 12 standard deviations either side of the mean; the mass outside it is
+// far below one draw in 2^32. Each pmf term is computed in log space so
+// large means do not underflow exp(-mean). A sample is the window start
+// plus the number of thresholds not above the draw, found by a branchless
+// binary search. The thresholds are padded with UINT32_MAX to a power of
+// two so the SIMD kernels can run the same search with gathers
+class PoissonTable {
+  public:
+    PoissonTable() = default;
+
+    explicit PoissonTable(const double mean) {
+      const double spread = 12.0 * std::sqrt(mean) + 16.0;
+      lo = static_cast<int>(std::max(0.0, std::floor(mean - spread)));
+      const int hi = static_cast<int>(std::ceil(mean + spread));
+      const double log_mean = std::log(mean);
+
+      // cdf <= x / 2^32 exactly when ceil(cdf * 2^32) <= x. Entries that
+      // round up to 2^32 can never be reached by a 32 bit draw
+      bit_table.clear();
+      double cdf = 0.0;
+      for(int k = lo; k <= hi; k++) {
+        cdf += (k == 0) ? std::exp(-mean) : std::exp(k * log_mean - mean - std::lgamma(k + 1.0));
+        const double scaled = std::ceil(cdf * 4294967296.0);
+        if(scaled >= 4294967296.0)
+          break;
+        bit_table.push_back(static_cast<uint32_t>(scaled));
+      }
+
+      num = static_cast<int>(bit_table.size());
+      int padded = 1;
+      while(padded < num + 1)
+        padded *= 2;
+      bit_table.resize(padded, UINT32_MAX);
+    }
+
+    inline int sampleBits(const uint32_t x) const {
+      int pos = 0;
+      for(int step = static_cast<int>(bit_table.size()) / 2; step > 0; step /= 2)
+        pos += (bit_table[pos + step - 1] <= x) ? step : 0;
+      return lo + std::min(pos, num);
+    }
+
+    // Padded thresholds; a power of two long with at least one pad entry
+    const std::vector<uint32_t>& thresholds() const { return bit_table; }
+    int numThresholds() const { return num; }
+    int offset() const { return lo; }
+
+  private:
+    std::vector<uint32_t> bit_table = std::vector<uint32_t>(1, UINT32_MAX);
+    int num = 0;
+    int lo = 0;
+};
+
+#endif
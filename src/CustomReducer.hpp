@@ -1,60 +1,303 @@
 #ifndef CUSTOM_REDUCER_HPP
 #define CUSTOM_REDUCER_HPP
 #include <vt/transport.h>
+#include "ParticleStorage.hpp"
 #include <vector>
 #include <utility>
+#include <algorithm>
+#include <array>
+#include <cmath>
+#include <string>
 
-struct CustomPayload {
-  CustomPayload() = default;
-  CustomPayload(int in_node, int in_count) {
-    vec.emplace_back(in_node, in_count);
+// Bins of the tile histograms. Bin 0 holds values below the unit, bin k
+// values in [unit * 2^(k-1), unit * 2^k) and the last bin everything above,
+// so histograms merge without knowing the range up front
+constexpr int histogram_bins = 32;
+
+// Distribution of one per-tile quantity: sum, min and max with their
+// tiles, Welford mean and variance, and a log2 histogram. Merging is
+// in-tree and the size is fixed, whatever the number of tiles
+struct TileDistribution {
+  TileDistribution() = default;
+  TileDistribution(int in_tile, double x, double in_unit) : count(1), sum(x), mean(x), min(x), max(x),
+    min_tile(in_tile), max_tile(in_tile), unit(in_unit) {
+    histogram[bin(x)] = 1;
+  }
+
+  int bin(double x) const {
+    if(x < unit)
+      return 0;
+    const int k = static_cast<int>(std::floor(std::log2(x / unit))) + 1;
+    return std::min(k, histogram_bins - 1);
   }
 
-  friend CustomPayload operator+(CustomPayload& in1, CustomPayload const& in2) {
+  // Lower edge of bin k
+  double binStart(int k) const {
+    return k == 0 ? 0. : unit * std::ldexp(1., k - 1);
+  }
 
-    for(auto& elem : in2.vec) {
-      in1.vec.push_back(elem);
+  void merge(const TileDistribution& other) {
+    if(other.count == 0)
+      return;
+    if(count == 0) {
+      *this = other;
+      return;
     }
 
+    // Chan et al. update of the mean and sum of squared deviations
+    const long n = count + other.count;
+    const double delta = other.mean - mean;
+    mean += delta * other.count / n;
+    m2 += other.m2 + delta * delta * (static_cast<double>(count) * other.count / n);
+    count = n;
+    sum += other.sum;
+
+    if(other.min < min || (other.min == min && other.min_tile < min_tile)) {
+      min = other.min;
+      min_tile = other.min_tile;
+    }
+    if(other.max > max || (other.max == max && other.max_tile < max_tile)) {
+      max = other.max;
+      max_tile = other.max_tile;
+    }
+
+    for(int k = 0; k < histogram_bins; k++)
+      histogram[k] += other.histogram[k];
+  }
+
+  double stdev() const {
+    return count > 0 ? std::sqrt(m2 / count) : 0.;
+  }
+
+  template <typename SerializerT>
+  void serialize(SerializerT& s) {
+    s | count | sum | mean | m2 | min | max | min_tile | max_tile | unit | histogram;
+  }
+
+  long count = 0;
+  double sum = 0.;
+  double mean = 0.;
+  double m2 = 0.;
+  double min = 0.;
+  double max = 0.;
+  int min_tile = -1;
+  int max_tile = -1;
+  double unit = 1.;
+  std::array<long, histogram_bins> histogram{};
+};
+
+// End of run particle counts and work of every tile
+struct TileSummary {
+  TileSummary() = default;
+  TileSummary(int in_tile, int in_count, double in_seconds)
+    : particles(in_tile, in_count, 1.), work(in_tile, in_seconds, 1e-6) {}
+
+  friend TileSummary operator+(TileSummary& in1, TileSummary const& in2) {
+    in1.particles.merge(in2.particles);
+    in1.work.merge(in2.work);
     return in1;
   }
 
   template <typename SerializerT>
   void serialize(SerializerT& s) {
-    s | vec;
+    s | particles | work;
   }
 
-  std::vector<std::pair<int, int>> vec;
+  TileDistribution particles;
+  TileDistribution work;
 };
 
-// Msg to carry the custom payload we reduce into the result
-struct CustomPayloadMsg : vt::collective::ReduceTMsg<CustomPayload> {
-  CustomPayloadMsg() = default;
+struct TileSummaryMsg : vt::collective::ReduceTMsg<TileSummary> {
+  TileSummaryMsg() = default;
 
-  CustomPayloadMsg(int in_node, int in_count) : vt::collective::ReduceTMsg<CustomPayload>() {
-    auto& vec = getVal().vec;
-    vec.push_back(std::make_pair(in_node, in_count));
+  TileSummaryMsg(int in_tile, int in_count, double in_seconds) : vt::collective::ReduceTMsg<TileSummary>() {
+    getVal() = TileSummary(in_tile, in_count, in_seconds);
   }
 
   template <typename SerializerT>
   void serialize(SerializerT& s) {
-    ReduceTMsg<CustomPayload>::invokeSerialize(s);
+    ReduceTMsg<TileSummary>::invokeSerialize(s);
   }
 };
 
+inline void printTileDistribution(const std::string& name, const TileDistribution& dist) {
+  fmt::print("{}: min {} (tile {}), mean {:.5f}, max {} (tile {}), stdev {:.5f}\n",
+    name, dist.min, dist.min_tile, dist.mean, dist.max, dist.max_tile, dist.stdev());
+
+  for(int k = 0; k < histogram_bins; k++) {
+    if(dist.histogram[k] == 0)
+      continue;
+
+    if(k == histogram_bins - 1)
+      fmt::print("  [{}, inf): {}\n", dist.binStart(k), dist.histogram[k]);
+    else
+      fmt::print("  [{}, {}): {}\n", dist.binStart(k), dist.binStart(k + 1), dist.histogram[k]);
+  }
+}
+
 struct PrintReduceResult {
   PrintReduceResult() = default;
   ~PrintReduceResult() = default;
 
-  void operator() (CustomPayloadMsg* msg) {
-    const auto& vec = msg->getConstVal().vec;
-    int total = 0;
-        
-    for(auto& elem : vec) {
-      total += elem.second;
-      fmt::print("Tile {} has {} particles\n", elem.first, elem.second);
-    }   
-    fmt::print("Total Particles: {}\n", total);
+  void operator() (TileSummaryMsg* msg) {
+    const auto& val = msg->getConstVal();
+
+    fmt::print("Total Particles: {}\n", static_cast<long>(val.particles.sum));
+    printTileDistribution("Particles per tile", val.particles);
+    printTileDistribution("Work seconds per tile", val.work);
+  }
+};
+
+// Per-step migration buffer growth counts, summed element-wise over tiles
+struct BufferGrowthPayload {
+  BufferGrowthPayload() = default;
+  BufferGrowthPayload(const std::vector<int>& in_per_step) : per_step(in_per_step) {}
+
+  friend BufferGrowthPayload operator+(BufferGrowthPayload& in1, BufferGrowthPayload const& in2) {
+    if(in1.per_step.size() < in2.per_step.size())
+      in1.per_step.resize(in2.per_step.size());
+
+    for(int i = 0; i < in2.per_step.size(); i++) {
+      in1.per_step[i] += in2.per_step[i];
+    }
+
+    return in1;
+  }
+
+  template <typename SerializerT>
+  void serialize(SerializerT& s) {
+    s | per_step;
+  }
+
+  std::vector<int> per_step;
+};
+
+struct BufferGrowthMsg : vt::collective::ReduceTMsg<BufferGrowthPayload> {
+  BufferGrowthMsg() = default;
+
+  BufferGrowthMsg(const std::vector<int>& in_per_step) : vt::collective::ReduceTMsg<BufferGrowthPayload>() {
+    getVal().per_step = in_per_step;
+  }
+
+  template <typename SerializerT>
+  void serialize(SerializerT& s) {
+    ReduceTMsg<BufferGrowthPayload>::invokeSerialize(s);
+  }
+};
+
+struct PrintBufferGrowthResult {
+  PrintBufferGrowthResult() = default;
+  ~PrintBufferGrowthResult() = default;
+
+  void operator() (BufferGrowthMsg* msg) {
+    const auto& per_step = msg->getConstVal().per_step;
+
+    for(int step = 0; step < per_step.size(); step++) {
+      fmt::print("Step {} migration buffer growth: {}\n", step, per_step[step]);
+    }
+  }
+};
+
+// Migrated particle counts split by whether the destination tile was on
+// the sending node
+struct MigrationLocality {
+  MigrationLocality() = default;
+  MigrationLocality(long in_on_node, long in_off_node) : on_node(in_on_node), off_node(in_off_node) {}
+
+  friend MigrationLocality operator+(MigrationLocality& in1, MigrationLocality const& in2) {
+    in1.on_node += in2.on_node;
+    in1.off_node += in2.off_node;
+    return in1;
+  }
+
+  template <typename SerializerT>
+  void serialize(SerializerT& s) {
+    s | on_node | off_node;
+  }
+
+  long on_node = 0;
+  long off_node = 0;
+};
+
+struct MigrationLocalityMsg : vt::collective::ReduceTMsg<MigrationLocality> {
+  MigrationLocalityMsg() = default;
+
+  MigrationLocalityMsg(long in_on_node, long in_off_node) : vt::collective::ReduceTMsg<MigrationLocality>() {
+    getVal() = MigrationLocality(in_on_node, in_off_node);
+  }
+
+  template <typename SerializerT>
+  void serialize(SerializerT& s) {
+    ReduceTMsg<MigrationLocality>::invokeSerialize(s);
+  }
+};
+
+struct PrintMigrationLocalityResult {
+  PrintMigrationLocalityResult() = default;
+  ~PrintMigrationLocalityResult() = default;
+
+  void operator() (MigrationLocalityMsg* msg) {
+    const auto& val = msg->getConstVal();
+    const long total = val.on_node + val.off_node;
+    const double on_pct = total > 0 ? (100. * val.on_node) / total : 0.;
+
+    fmt::print("Migrations on node: {} ({:.2f}%), off node: {}\n", val.on_node, on_pct, val.off_node);
+  }
+};
+
+// Particle storage statistics over tiles. Per-tile values are in the
+// tile dump
+struct StorageSummary {
+  StorageSummary() = default;
+  StorageSummary(int in_tile, const StorageStats& in_stats)
+    : bytes(in_tile, in_stats.bytes, 4096.), peak_bytes(in_tile, in_stats.peak_bytes, 4096.),
+      grows(in_tile, in_stats.grows, 1.), shrinks(in_tile, in_stats.shrinks, 1.) {}
+
+  friend StorageSummary operator+(StorageSummary& in1, StorageSummary const& in2) {
+    in1.bytes.merge(in2.bytes);
+    in1.peak_bytes.merge(in2.peak_bytes);
+    in1.grows.merge(in2.grows);
+    in1.shrinks.merge(in2.shrinks);
+    return in1;
+  }
+
+  template <typename SerializerT>
+  void serialize(SerializerT& s) {
+    s | bytes | peak_bytes | grows | shrinks;
+  }
+
+  TileDistribution bytes;
+  TileDistribution peak_bytes;
+  TileDistribution grows;
+  TileDistribution shrinks;
+};
+
+struct StorageSummaryMsg : vt::collective::ReduceTMsg<StorageSummary> {
+  StorageSummaryMsg() = default;
+
+  StorageSummaryMsg(int in_tile, const StorageStats& in_stats) : vt::collective::ReduceTMsg<StorageSummary>() {
+    getVal() = StorageSummary(in_tile, in_stats);
+  }
+
+  template <typename SerializerT>
+  void serialize(SerializerT& s) {
+    ReduceTMsg<StorageSummary>::invokeSerialize(s);
+  }
+};
+
+struct PrintStorageResult {
+  PrintStorageResult() = default;
+  ~PrintStorageResult() = default;
+
+  void operator() (StorageSummaryMsg* msg) {
+    const auto& val = msg->getConstVal();
+
+    fmt::print("Total storage: {} bytes, sum of peaks {} bytes\n",
+      static_cast<long>(val.bytes.sum), static_cast<long>(val.peak_bytes.sum));
+    printTileDistribution("Storage bytes per tile", val.bytes);
+    printTileDistribution("Peak storage bytes per tile", val.peak_bytes);
+    printTileDistribution("Storage grows per tile", val.grows);
+    printTileDistribution("Storage shrinks per tile", val.shrinks);
   }
 };
 
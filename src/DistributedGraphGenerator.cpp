@@ -0,0 +1,72 @@
+#include "DistributedGraphGenerator.hpp"
+
+#include <algorithm>
+#include <cmath>
+
+DistributedGraphGenerator::DistributedGraphGenerator(int num_nodes_, double ave_degree_, int seed_) :
+  num_nodes(num_nodes_), ave_degree(ave_degree_), seed(hashMix(static_cast<uint64_t>(seed_))) {
+
+  // The ring gives degree 2, pairing off gives degree 1
+  ring = ave_degree > 1.;
+  const double remaining = std::max(0., ave_degree - (ring ? 2. : 1.));
+
+  // Each permutation adds two to every node's degree
+  const int full = static_cast<int>(remaining / 2.);
+  partial_fraction = (remaining - 2. * full) / 2.;
+
+  const int count = full + (partial_fraction > 0. ? 1 : 0);
+  for(int k = 0; k < count; k++)
+    permutations.emplace_back(num_nodes, hashCombine(seed, k));
+}
+
+bool DistributedGraphGenerator::keepPartialEdge(const int node) const {
+  const uint64_t h = hashCombine(seed ^ 0x5bd1e995ULL, static_cast<uint64_t>(node));
+  return hashToUnit(h) < partial_fraction;
+}
+
+const std::vector<int> DistributedGraphGenerator::getNodeNeighbours(const int node) {
+  std::vector<int> ret;
+  if(num_nodes <= 1) {
+    // A single node is its own neighbour, as in the global generator
+    if(num_nodes == 1)
+      ret.push_back(0);
+    return ret;
+  }
+
+  if(ring) {
+    ret.push_back((node + 1) % num_nodes);
+    ret.push_back((node + num_nodes - 1) % num_nodes);
+  } else {
+    // With an odd count the last node joins the last pair
+    const int partner = node ^ 1;
+    if(partner < num_nodes)
+      ret.push_back(partner);
+    else
+      ret.push_back(node - 1);
+
+    if((num_nodes % 2) == 1 && node == num_nodes - 2)
+      ret.push_back(num_nodes - 1);
+  }
+
+  const int nperm = permutations.size();
+  for(int k = 0; k < nperm; k++) {
+    const auto& perm = permutations[k];
+    const bool partial = (k == nperm - 1) && partial_fraction > 0.;
+
+    // Edge where we are the source
+    const int to = perm.forward(node);
+    if(!partial || keepPartialEdge(node))
+      ret.push_back(to);
+
+    // Edge where we are the target
+    const int from = perm.inverse(node);
+    if(!partial || keepPartialEdge(from))
+      ret.push_back(from);
+  }
+
+  std::sort(ret.begin(), ret.end());
+  ret.erase(std::unique(ret.begin(), ret.end()), ret.end());
+  ret.erase(std::remove(ret.begin(), ret.end(), node), ret.end());
+
+  return ret;
+}
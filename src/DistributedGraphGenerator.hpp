@@ -0,0 +1,39 @@
+#ifndef DISTRIBUTED_GRAPH_GENERATOR_HPP
+#define DISTRIBUTED_GRAPH_GENERATOR_HPP
+#include "NeighbourGraph.hpp"
+#include "CounterRNG.hpp"
+
+#include <vector>
+#include <cstdint>
+
+// Random neighbour graph where any node's neighbour list can be worked out
+// on its own, so a rank only has to build the rows of its own tiles.
+// Nodes are joined into a ring (or paired up for degrees of 1 or less),
+// then each further pair of degree comes from a keyed pseudorandom
+// permutation p, linking i to p(i) and to p^-1(i). A fractional remainder
+// uses one more permutation whose edges are kept by a hash coin flip on
+// the edge's source. Everything is a pure function of (seed, num_nodes), so
+// the graph does not depend on the number of ranks.
+// The average degree is met in expectation: the odd self or repeated edge
+// is dropped, which only matters on small graphs
+class DistributedGraphGenerator : public NeighbourGraph {
+  public:
+    DistributedGraphGenerator() = delete;
+
+    DistributedGraphGenerator(int num_nodes_, double ave_degree_, int seed_);
+
+    const std::vector<int> getNodeNeighbours(const int node) override;
+
+  private:
+    // Is edge (node, p_k(node)) of the partial permutation kept
+    bool keepPartialEdge(const int node) const;
+
+    int num_nodes;
+    double ave_degree;
+    uint64_t seed;
+    bool ring;
+    std::vector<HashPermutation> permutations;
+    double partial_fraction = 0.;
+};
+
+#endif
@@ -9,25 +9,10 @@
 #include <cstdlib>
 
 GraphGenerator::GraphGenerator(int num_nodes_, double ave_degree_, int seed_) :
-  num_nodes(num_nodes_), ave_degree(ave_degree_) {
-  
-  matrix.resize(num_nodes_);
-  for(int i = 0; i < num_nodes_; i++)
-    matrix[i].resize(num_nodes_);
-
-  for(int i = 0; i < num_nodes_; i++) {
-    for(int j = 0; j < num_nodes_; j++) {
-      if(i < j) {
-        positions.emplace_back(i, j);
-      }
-    }
-  }
-
-  // Randomise the order in advance
-  std::mt19937 eng(seed_);
-  std::shuffle(std::begin(positions), std::end(positions), eng);
+  num_nodes(num_nodes_), ave_degree(ave_degree_), eng(seed_) {
 
   generateGraph();
+  buildAdjacency();
 }
 
 void GraphGenerator::generateGraph() {
@@ -47,31 +32,92 @@ void GraphGenerator::generateGraph() {
       addEdge(i, i+1);
   }
 
-  // Close the loop
-  if(averageDegree() < ave_degree)
+  // Close the loop. A single node ends up as its own neighbour
+  if(averageDegree() < ave_degree && num_nodes > 0)
     addEdge(0, num_nodes-1);
 
   // Now we add connections until desired average is reached
   // Or we run out of possible edges to add
-  while(positions.size()) {
+  addRandomEdges();
+}
+
+void GraphGenerator::addRandomEdges() {
+  const long max_edges = static_cast<long>(num_nodes) * (num_nodes - 1) / 2;
+
+  // Sparse case: sample pairs and reject the ones we already have. While
+  // at most half the pairs are taken each draw succeeds with p >= 1/2
+  std::uniform_int_distribution<int> node_dist(0, std::max(num_nodes - 1, 0));
+  while(averageDegree() < ave_degree && num_edges < max_edges / 2) {
+    int i = node_dist(eng);
+    int j = node_dist(eng);
+    if(i == j)
+      continue;
+    if(i > j)
+      std::swap(i, j);
+    addEdge(i, j);
+  }
+
+  if(averageDegree() >= ave_degree || num_edges >= max_edges)
+    return;
+
+  // Dense case: only reachable on small graphs, so list the remaining
+  // pairs and take them in random order
+  std::vector<std::pair<int, int>> remaining;
+  remaining.reserve(max_edges - num_edges);
+  for(int i = 0; i < num_nodes; i++) {
+    for(int j = i + 1; j < num_nodes; j++) {
+      if(edge_set.count(edgeKey(i, j)) == 0)
+        remaining.emplace_back(i, j);
+    }
+  }
+
+  std::shuffle(std::begin(remaining), std::end(remaining), eng);
+
+  for(auto& elem : remaining) {
     if(averageDegree() >= ave_degree)
       break;
-
-    auto& elem = positions[0];
     addEdge(elem.first, elem.second);
   }
 }
 
 void GraphGenerator::addEdge(const int i, const int j) {
-  if(matrix[i][j] == 0 && matrix[j][i] == 0) {
-    matrix[i][j] = 1;
-    matrix[j][i] = 1;
+  const int lo = std::min(i, j);
+  const int hi = std::max(i, j);
+
+  if(edge_set.insert(edgeKey(lo, hi)).second) {
     num_edges++;
-    positions.erase(std::remove(std::begin(positions), std::end(positions), std::make_pair(i, j)));
     edges.emplace_back(i, j);
   }
 }
 
+void GraphGenerator::buildAdjacency() {
+  // Count degrees, then scatter both directions of every edge
+  offsets.assign(num_nodes + 1, 0);
+  for(auto& elem : edges) {
+    offsets[elem.first + 1]++;
+    if(elem.second != elem.first)
+      offsets[elem.second + 1]++;
+  }
+
+  for(int i = 0; i < num_nodes; i++)
+    offsets[i + 1] += offsets[i];
+
+  adjacency.resize(offsets[num_nodes]);
+  std::vector<int> fill(offsets.begin(), offsets.end() - 1);
+  for(auto& elem : edges) {
+    adjacency[fill[elem.first]++] = elem.second;
+    if(elem.second != elem.first)
+      adjacency[fill[elem.second]++] = elem.first;
+  }
+
+  // Neighbour lists come back in ascending order
+  for(int i = 0; i < num_nodes; i++)
+    std::sort(adjacency.begin() + offsets[i], adjacency.begin() + offsets[i + 1]);
+
+  // Only needed while generating
+  edge_set.clear();
+}
+
 void GraphGenerator::printMatrix() {
   std::cout << "\t";
   for(int i = 0; i < num_nodes; i++)
@@ -80,8 +126,14 @@ void GraphGenerator::printMatrix() {
 
   for(int i = 0; i < num_nodes; i++) {
     std::cout << i << "\t";
+    auto neighbour = adjacency.begin() + offsets[i];
     for(int j = 0; j < num_nodes; j++) {
-      std::cout << matrix[i][j] << "\t";
+      int connected = 0;
+      if(neighbour != adjacency.begin() + offsets[i + 1] && *neighbour == j) {
+        connected = 1;
+        neighbour++;
+      }
+      std::cout << connected << "\t";
     }
     std::cout << std::endl;
   }
@@ -92,18 +144,7 @@ const std::vector<std::pair<int, int>>& GraphGenerator::getEdgeVector() {
 }
 
 const std::vector<int> GraphGenerator::getNodeNeighbours(const int node) {
-  std::vector<int> ret;
-  for(int i = 0; i < matrix[node].size(); i++) {
-    if(matrix[node][i] == 1)
-      ret.push_back(i);
-  }
-
-  return ret;
-}
-
-void GraphGenerator::printPositions() {
-  for(auto& elem : positions)
-    std::cout << "(" << elem.first << ", " << elem.second << ")" << std::endl;
+  return std::vector<int>(adjacency.begin() + offsets[node], adjacency.begin() + offsets[node + 1]);
 }
 
 double GraphGenerator::averageDegree() {
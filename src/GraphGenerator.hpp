@@ -1,3 +1,5 @@
+#ifndef GRAPH_GENERATOR_HPP
+#define GRAPH_GENERATOR_HPP
 #include <iostream>
 #include <fstream>
 #include <vector>
@@ -5,8 +7,16 @@
 #include <random>
 #include <algorithm>
 #include <cstdlib>
+#include <cstdint>
+#include <unordered_set>
 
-class GraphGenerator {
+#include "NeighbourGraph.hpp"
+
+// Random neighbour graph with tiles as nodes. Nodes are first joined into
+// a ring, then random edges are added until the requested average degree
+// is reached. Adjacency is stored in compressed sparse row form so memory
+// and time scale with the number of edges rather than nodes squared
+class GraphGenerator : public NeighbourGraph {
 
   public:
     GraphGenerator() = delete;
@@ -17,21 +27,36 @@ class GraphGenerator {
 
     void addEdge(const int i, const int j);
 
+    // Dense dump of the adjacency, only sensible for small graphs
     void printMatrix();
 
     const std::vector<std::pair<int, int>>& getEdgeVector();
 
-    const std::vector<int> getNodeNeighbours(const int node);
-
-    void printPositions();
+    const std::vector<int> getNodeNeighbours(const int node) override;
 
     double averageDegree();
 
   private:
+    // Key for the undirected edge (i, j) with i < j
+    inline uint64_t edgeKey(const int i, const int j) const {
+      return static_cast<uint64_t>(i) * num_nodes + j;
+    }
+
+    // Add random edges from the remaining pairs until the average degree
+    // is reached or there are no pairs left
+    void addRandomEdges();
+
+    // Build the CSR adjacency from the edge list
+    void buildAdjacency();
+
     int num_nodes;
     double ave_degree;
-    std::vector<std::vector<int>> matrix;
-    std::vector<std::pair<int, int>> positions;
+    std::mt19937 eng;
+    std::unordered_set<uint64_t> edge_set;
     std::vector<std::pair<int, int>> edges;
+    std::vector<int> offsets;
+    std::vector<int> adjacency;
     int num_edges = 0;
 };
+
+#endif
@@ -8,6 +8,11 @@ int InputDeck::load(const char* name) {
     nsteps = input_deck["Timesteps"].as<int>();
     nparticles = input_deck["Particle Count"].as<int>();
     ave_crossings = input_deck["Average Crossings"].as<double>();
+    // Bounds the crossing table at a few tens of thousands of entries
+    if(!(ave_crossings >= 0.0 && ave_crossings <= 1e6)) {
+      fmt::print("Average Crossings must be between 0 and 1e6!\n");
+      return -1;
+    }
     base_seed = input_deck["Crossing RNG Seed"].as<int>();
     rng_seed = base_seed + vt::theContext()->getNode();
     move_part_ns = input_deck["Move Particle Nanoseconds"].as<int>();
@@ -17,7 +22,299 @@ int InputDeck::load(const char* name) {
     overdecompose = input_deck["Overdecompose"].as<int>();
 
     ave_neighbours = input_deck["Average Neighbours"].as<double>();
+
+    // Optional: build the whole neighbour graph everywhere (Global) or
+    // only the rows of local tiles (Distributed)
+    if(input_deck["Graph Generation"]) {
+      const auto graph_name = input_deck["Graph Generation"].as<std::string>();
+      if(graph_name == "Global") {
+        graph_generation = GraphGeneration::Global;
+      } else if(graph_name == "Distributed") {
+        graph_generation = GraphGeneration::Distributed;
+      } else {
+        fmt::print("Unknown Graph Generation '{}', expected Global or Distributed!\n", graph_name);
+        return -1;
+      }
+    }
+
+    // Optional: shape of the neighbour graph and, for grids, the stencil
+    if(input_deck["Topology"]) {
+      const auto topology_name = input_deck["Topology"].as<std::string>();
+      if(topology_name == "Random") {
+        topology = Topology::Random;
+      } else if(topology_name == "Mesh2D") {
+        topology = Topology::Mesh2D;
+      } else if(topology_name == "Mesh3D") {
+        topology = Topology::Mesh3D;
+      } else if(topology_name == "Torus2D") {
+        topology = Topology::Torus2D;
+      } else if(topology_name == "Torus3D") {
+        topology = Topology::Torus3D;
+      } else {
+        fmt::print("Unknown Topology '{}', expected Random, Mesh2D, Mesh3D, Torus2D or Torus3D!\n", topology_name);
+        return -1;
+      }
+    }
+
+    const bool three_d = (topology == Topology::Mesh3D || topology == Topology::Torus3D);
+    stencil_points = three_d ? 6 : 4;
+    if(input_deck["Stencil Points"])
+      stencil_points = input_deck["Stencil Points"].as<int>();
+
+    if(topology != Topology::Random) {
+      const bool valid = three_d ? (stencil_points == 6 || stencil_points == 26) : (stencil_points == 4 || stencil_points == 8);
+      if(!valid) {
+        fmt::print("Stencil Points must be {} for this topology!\n", three_d ? "6 or 26" : "4 or 8");
+        return -1;
+      }
+    }
+
+    // Optional: how the time of a particle move is spent
+    if(input_deck["Work Model"]) {
+      const auto work_name = input_deck["Work Model"].as<std::string>();
+      if(work_name == "Sleep") {
+        work_model = WorkModelType::Sleep;
+      } else if(work_name == "Spin") {
+        work_model = WorkModelType::Spin;
+      } else if(work_name == "Compute") {
+        work_model = WorkModelType::Compute;
+      } else if(work_name == "Memory") {
+        work_model = WorkModelType::Memory;
+      } else {
+        fmt::print("Unknown Work Model '{}', expected Sleep, Spin, Compute or Memory!\n", work_name);
+        return -1;
+      }
+    }
+
+    // Optional: particle storage layout, AoS or SoA
+    if(input_deck["Particle Layout"]) {
+      const auto layout_name = input_deck["Particle Layout"].as<std::string>();
+      if(layout_name == "AoS") {
+        layout = ParticleLayout::AoS;
+      } else if(layout_name == "SoA") {
+        layout = ParticleLayout::SoA;
+      } else {
+        fmt::print("Unknown Particle Layout '{}', expected AoS or SoA!\n", layout_name);
+        return -1;
+      }
+    }
     
+    // Optional: print per-step migration buffer growth counts at the end
+    if(input_deck["Report Buffer Growth"])
+      report_buffer_growth = input_deck["Report Buffer Growth"].as<bool>();
+
+    // Optional: coalesce incoming migrations before moving them on
+    if(input_deck["Migration Aggregation"]) {
+      const auto& agg_node = input_deck["Migration Aggregation"];
+      auto& agg = mover_config.aggregation;
+
+      agg.enabled = agg_node["Enabled"].as<bool>();
+      if(agg_node["Max Messages"])
+        agg.max_messages = agg_node["Max Messages"].as<int>();
+      if(agg_node["Max Particles"])
+        agg.max_particles = agg_node["Max Particles"].as<int>();
+      if(agg_node["Max Wait Microseconds"])
+        agg.max_wait_us = agg_node["Max Wait Microseconds"].as<double>();
+    }
+
+    // Optional: batch migrations per destination node
+    if(input_deck["Node Aggregation"]) {
+      const auto& node_agg_node = input_deck["Node Aggregation"];
+      auto& node_agg = mover_config.node_aggregation;
+
+      node_agg.enabled = node_agg_node["Enabled"].as<bool>();
+      if(node_agg_node["Max Bytes"])
+        node_agg.max_bytes = node_agg_node["Max Bytes"].as<long>();
+    }
+
+    // Optional: Mersenne or Counter random numbers for move decisions
+    mover_config.rng.seed = base_seed;
+    if(input_deck["RNG"]) {
+      const auto rng_name = input_deck["RNG"].as<std::string>();
+      if(rng_name == "Mersenne") {
+        mover_config.rng.mode = RNGMode::Mersenne;
+      } else if(rng_name == "Counter") {
+        mover_config.rng.mode = RNGMode::Counter;
+      } else {
+        fmt::print("Unknown RNG '{}', expected Mersenne or Counter!\n", rng_name);
+        return -1;
+      }
+    }
+
+    // Optional: Loop or ClosedForm resolution of particle moves
+    if(input_deck["Move Kernel"]) {
+      const auto kernel_name = input_deck["Move Kernel"].as<std::string>();
+      if(kernel_name == "Loop") {
+        mover_config.kernel = MoveKernelMode::Loop;
+      } else if(kernel_name == "ClosedForm") {
+        mover_config.kernel = MoveKernelMode::ClosedForm;
+      } else {
+        fmt::print("Unknown Move Kernel '{}', expected Loop or ClosedForm!\n", kernel_name);
+        return -1;
+      }
+    }
+
+    // Optional: keep particle order when compacting out migrants
+    if(input_deck["Stable Compaction"])
+      mover_config.stable_compaction = input_deck["Stable Compaction"].as<bool>();
+
+    // Optional: Phased or Pipelined timesteps, and how far a pipelined
+    // window may run ahead
+    if(input_deck["Step Driver"]) {
+      const auto driver_name = input_deck["Step Driver"].as<std::string>();
+      if(driver_name == "Phased") {
+        step_config.driver = StepDriver::Phased;
+      } else if(driver_name == "Pipelined") {
+        step_config.driver = StepDriver::Pipelined;
+      } else {
+        fmt::print("Unknown Step Driver '{}', expected Phased or Pipelined!\n", driver_name);
+        return -1;
+      }
+    }
+
+    if(input_deck["Run Ahead"]) {
+      step_config.run_ahead = input_deck["Run Ahead"].as<int>();
+      if(step_config.run_ahead < 0) {
+        fmt::print("Run Ahead must not be negative, got {}\n", step_config.run_ahead);
+        return -1;
+      }
+    }
+
+    // Optional: start the tiles with a Broadcast from node 0 or Local calls
+    // on every node
+    if(input_deck["Step Start"]) {
+      const auto start_name = input_deck["Step Start"].as<std::string>();
+      if(start_name == "Broadcast") {
+        step_config.start = StepStart::Broadcast;
+      } else if(start_name == "Local") {
+        step_config.start = StepStart::Local;
+      } else {
+        fmt::print("Unknown Step Start '{}', expected Broadcast or Local!\n", start_name);
+        return -1;
+      }
+    }
+
+    // Optional: threads per process used by the move kernel
+    if(input_deck["Move Threads"]) {
+      mover_config.move_threads = input_deck["Move Threads"].as<int>();
+      if(mover_config.move_threads < 1) {
+        fmt::print("Move Threads must be at least 1, got {}\n", mover_config.move_threads);
+        return -1;
+      }
+    }
+
+    // Optional: growth policy and backing of particle storage
+    if(input_deck["Particle Storage"]) {
+      const auto& storage_node = input_deck["Particle Storage"];
+
+      if(storage_node["Chunk Particles"])
+        storage_config.chunk_particles = storage_node["Chunk Particles"].as<int>();
+      if(storage_node["Growth Factor"])
+        storage_config.growth_factor = storage_node["Growth Factor"].as<double>();
+      if(storage_node["Low Watermark"])
+        storage_config.low_watermark = storage_node["Low Watermark"].as<double>();
+      if(storage_node["High Watermark"])
+        storage_config.high_watermark = storage_node["High Watermark"].as<double>();
+      if(storage_node["Huge Pages"])
+        storage_config.huge_pages = storage_node["Huge Pages"].as<bool>();
+      if(storage_node["NUMA Local"])
+        storage_config.numa_local = storage_node["NUMA Local"].as<bool>();
+      if(storage_node["Report"])
+        storage_config.report = storage_node["Report"].as<bool>();
+
+      const bool valid = storage_config.chunk_particles > 0 && storage_config.growth_factor >= 1.
+        && storage_config.low_watermark >= 0. && storage_config.low_watermark < storage_config.high_watermark
+        && storage_config.high_watermark <= 1.;
+      if(!valid) {
+        fmt::print("Particle Storage needs Chunk Particles > 0, Growth Factor >= 1 and 0 <= Low Watermark < High Watermark <= 1!\n");
+        return -1;
+      }
+    }
+
+    // Optional: file to write every tile's final particle count to
+    if(input_deck["Tile Dump"])
+      tile_dump_file = input_deck["Tile Dump"].as<std::string>();
+
+    // Optional: trace files are <prefix>.<node>.json, in builds with
+    // PARTEXCHANGE_TRACE
+    if(input_deck["Trace Prefix"])
+      trace_prefix = input_deck["Trace Prefix"].as<std::string>();
+
+    // Optional: per-step, per-tile measurements summarised into a file
+    if(input_deck["Telemetry"]) {
+      const auto& telemetry_node = input_deck["Telemetry"];
+
+      telemetry_config.enabled = telemetry_node["Enabled"].as<bool>();
+      if(telemetry_node["File"])
+        telemetry_config.file = telemetry_node["File"].as<std::string>();
+      if(telemetry_node["Flush Interval"]) {
+        telemetry_config.flush_interval = telemetry_node["Flush Interval"].as<int>();
+        if(telemetry_config.flush_interval < 0) {
+          fmt::print("Telemetry Flush Interval must not be negative, got {}\n", telemetry_config.flush_interval);
+          return -1;
+        }
+      }
+      if(telemetry_node["Quantiles"])
+        telemetry_config.quantiles = telemetry_node["Quantiles"].as<bool>();
+      if(telemetry_node["Format"]) {
+        const auto format_name = telemetry_node["Format"].as<std::string>();
+        if(format_name == "YAML") {
+          telemetry_config.format = OutputFormat::YAML;
+        } else if(format_name == "CSV") {
+          telemetry_config.format = OutputFormat::CSV;
+        } else {
+          fmt::print("Unknown Telemetry Format '{}', expected YAML or CSV!\n", format_name);
+          return -1;
+        }
+      }
+    }
+
+    // Optional: periodic checkpoints, written to <prefix>.s<step>.r<node>
+    if(input_deck["Checkpoint"]) {
+      const auto& checkpoint_node = input_deck["Checkpoint"];
+
+      checkpoint_config.interval = checkpoint_node["Interval"].as<int>();
+      if(checkpoint_config.interval < 0) {
+        fmt::print("Checkpoint Interval must not be negative, got {}\n", checkpoint_config.interval);
+        return -1;
+      }
+      if(checkpoint_node["Prefix"])
+        checkpoint_config.prefix = checkpoint_node["Prefix"].as<std::string>();
+    }
+
+    // Optional: checkpoint to start from, <prefix>.s<step>
+    if(input_deck["Restart From"])
+      checkpoint_config.restart = input_deck["Restart From"].as<std::string>();
+
+    // Optional: periodic load balancing of tiles over nodes
+    if(input_deck["Load Balancing"]) {
+      const auto& lb_node = input_deck["Load Balancing"];
+
+      lb_config.interval = lb_node["Interval"].as<int>();
+      if(lb_node["Tolerance"])
+        lb_config.tolerance = lb_node["Tolerance"].as<double>();
+      if(lb_node["Strategy"]) {
+        const auto strategy_name = lb_node["Strategy"].as<std::string>();
+        if(strategy_name == "Greedy") {
+          lb_config.strategy = LBStrategy::Greedy;
+        } else if(strategy_name == "Refine") {
+          lb_config.strategy = LBStrategy::Refine;
+        } else {
+          fmt::print("Unknown Load Balancing Strategy '{}', expected Greedy or Refine!\n", strategy_name);
+          return -1;
+        }
+      }
+    }
+
+    // Optional: particle size, which has to match the executable variant
+    if(input_deck["Particle Bytes"]) {
+      const int particle_bytes = input_deck["Particle Bytes"].as<int>();
+      if(particle_bytes != sizeof(Particle)) {
+        fmt::print("Particle Bytes is {} but this executable is built for {}!\n", particle_bytes, sizeof(Particle));
+        return -1;
+      }
+    }
+
     if(vt::theContext()->getNumNodes()*overdecompose == 1) {
       migration_chance = 0;
       std::cout << "Running with only 1 rank/tile: Forcing migration chance = 0!" << std::endl;
@@ -29,3 +326,15 @@ int InputDeck::load(const char* name) {
     return -1;
   }
 }
+
+int InputDeck::peekParticleBytes(const char* name) {
+  try {
+    const auto deck = YAML::LoadFile(name);
+    if(deck["Particle Bytes"])
+      return deck["Particle Bytes"].as<int>();
+  } catch(...) {
+    // Reported properly by load() once vt is up
+  }
+
+  return 0;
+}
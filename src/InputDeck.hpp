@@ -2,6 +2,30 @@
 #define INPUT_DECK_HPP
 #include "yaml-cpp/yaml.h"
 #include "fmt/format.h"
+#include "ParticleContainer.hpp"
+#include "MoverConfig.hpp"
+#include "NeighbourGraph.hpp"
+#include "LoadBalancer.hpp"
+#include "WorkModel.hpp"
+#include "Telemetry.hpp"
+#include "Checkpoint.hpp"
+
+// How timesteps are driven
+// Phased: one epoch to set every tile's moves, then one to move them
+// Pipelined: one epoch per window of steps, each tile setting its moves
+// and moving its particles back to back
+enum class StepDriver { Phased, Pipelined };
+
+// How the tiles are told to start each phase of a step
+// Broadcast: node 0 broadcasts to every tile
+// Local: every node calls the handler on its own tiles
+enum class StepStart { Broadcast, Local };
+
+struct StepConfig {
+  StepDriver driver = StepDriver::Phased;
+  int run_ahead = 0;   // extra steps a pipelined window may span
+  StepStart start = StepStart::Broadcast;
+};
 
 struct InputDeck {
   public:
@@ -9,10 +33,28 @@ struct InputDeck {
 
     int load(const char* name);
 
+    // The "Particle Bytes" entry of a deck, or 0 if it has none. Usable
+    // before vt is initialised
+    static int peekParticleBytes(const char* name);
+
     ~InputDeck() = default;
 
     YAML::Node input_deck;
     int nsteps, nparticles, base_seed, rng_seed, move_part_ns, migration_chance, overdecompose;;
     double ave_crossings, dist_stdev, ave_neighbours;
+    ParticleLayout layout = default_particle_layout;
+    bool report_buffer_growth = false;
+    std::string tile_dump_file;
+    std::string trace_prefix = "trace";
+    MoverConfig mover_config;
+    GraphGeneration graph_generation = GraphGeneration::Global;
+    Topology topology = Topology::Random;
+    int stencil_points = 0;
+    LoadBalanceConfig lb_config;
+    WorkModelType work_model = WorkModelType::Sleep;
+    StorageConfig storage_config;
+    StepConfig step_config;
+    TelemetryConfig telemetry_config;
+    CheckpointConfig checkpoint_config;
 };
 #endif
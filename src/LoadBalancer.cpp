@@ -0,0 +1,139 @@
+#include "LoadBalancer.hpp"
+
+#include <algorithm>
+#include <queue>
+#include <utility>
+#include <functional>
+
+static void lbAssignmentHandler(LBAssignmentMsg* msg) {
+  theLoadBalancer()->apply(msg->locations);
+}
+
+void LoadBalanceResult::operator() (TileLoadMsg* msg) {
+  auto loads = msg->getConstVal().loads;
+  theLoadBalancer()->balance(loads);
+}
+
+LoadBalancer* theLoadBalancer() {
+  static LoadBalancer balancer;
+  return &balancer;
+}
+
+void LoadBalancer::initialize(const PMProxyType& proxy_, const LoadBalanceConfig& config_) {
+  proxy = proxy_;
+  config = config_;
+}
+
+bool LoadBalancer::isDue(const int step) const {
+  return config.interval > 0 && step > 0 && (step % config.interval) == 0;
+}
+
+void LoadBalancer::balance(std::vector<TileLoad>& loads) {
+  // Reduction order is arbitrary, fix it so the result is reproducible
+  std::sort(loads.begin(), loads.end(), [](const TileLoad& a, const TileLoad& b) {
+    return a.tile < b.tile;
+  });
+
+  const auto locations = (config.strategy == LBStrategy::Refine) ? refine(loads) : greedy(loads);
+
+  int moved = 0;
+  for(auto& elem : loads) {
+    if(locations[elem.tile] != elem.node)
+      moved++;
+  }
+  fmt::print("Load balancer moving {} of {} tiles\n", moved, loads.size());
+
+  const int nnodes = vt::theContext()->getNumNodes();
+  for(int node = 0; node < nnodes; node++) {
+    auto msg = vt::makeSharedMessage<LBAssignmentMsg>();
+    msg->locations = locations;
+    vt::theMsg()->sendMsg<LBAssignmentMsg, lbAssignmentHandler>(node, msg);
+  }
+}
+
+std::vector<vt::NodeType> LoadBalancer::greedy(std::vector<TileLoad>& loads) {
+  const int nnodes = vt::theContext()->getNumNodes();
+  std::vector<vt::NodeType> locations(TileMap::numTiles());
+
+  std::vector<TileLoad> order(loads);
+  std::stable_sort(order.begin(), order.end(), [](const TileLoad& a, const TileLoad& b) {
+    return a.load > b.load;
+  });
+
+  // Least loaded node on top
+  using NodeLoad = std::pair<double, int>;
+  std::priority_queue<NodeLoad, std::vector<NodeLoad>, std::greater<NodeLoad>> nodes;
+  for(int node = 0; node < nnodes; node++)
+    nodes.emplace(0., node);
+
+  for(auto& elem : order) {
+    auto lightest = nodes.top();
+    nodes.pop();
+
+    locations[elem.tile] = lightest.second;
+    lightest.first += elem.load;
+    nodes.push(lightest);
+  }
+
+  return locations;
+}
+
+std::vector<vt::NodeType> LoadBalancer::refine(std::vector<TileLoad>& loads) {
+  const int nnodes = vt::theContext()->getNumNodes();
+  std::vector<vt::NodeType> locations(TileMap::numTiles());
+
+  std::vector<double> node_loads(nnodes, 0.);
+  std::vector<std::vector<TileLoad>> node_tiles(nnodes);
+  double total = 0.;
+  for(auto& elem : loads) {
+    locations[elem.tile] = elem.node;
+    node_loads[elem.node] += elem.load;
+    node_tiles[elem.node].push_back(elem);
+    total += elem.load;
+  }
+
+  const double threshold = config.tolerance * total / nnodes;
+
+  for(int node = 0; node < nnodes; node++) {
+    if(node_loads[node] <= threshold)
+      continue;
+
+    // Shed the heaviest tiles that fit somewhere first
+    auto& tiles = node_tiles[node];
+    std::stable_sort(tiles.begin(), tiles.end(), [](const TileLoad& a, const TileLoad& b) {
+      return a.load > b.load;
+    });
+
+    for(auto& elem : tiles) {
+      if(node_loads[node] <= threshold)
+        break;
+
+      const int lightest = std::min_element(node_loads.begin(), node_loads.end()) - node_loads.begin();
+      if(node_loads[lightest] + elem.load > threshold)
+        continue;
+
+      locations[elem.tile] = lightest;
+      node_loads[lightest] += elem.load;
+      node_loads[node] -= elem.load;
+    }
+  }
+
+  return locations;
+}
+
+void LoadBalancer::apply(const std::vector<vt::NodeType>& locations) {
+  const vt::NodeType me = vt::theContext()->getNode();
+  const auto local_tiles = TileMap::localTiles(me);
+
+  for(int tile = 0; tile < locations.size(); tile++)
+    TileMap::setNode(tile, locations[tile]);
+
+  for(auto& tile : local_tiles) {
+    if(locations[tile] == me)
+      continue;
+
+    auto local = proxy[tile].tryGetLocalPtr();
+    if(local != nullptr)
+      local->migrate(locations[tile]);
+  }
+}
@@ -0,0 +1,118 @@
+#ifndef LOAD_BALANCER_HPP
+#define LOAD_BALANCER_HPP
+#include "ParticleMover.hpp"
+#include "TileMap.hpp"
+
+#include <vt/transport.h>
+#include <vector>
+
+using PMProxyType = vt::vrt::collection::CollectionProxy<ParticleMover, IndexType>;
+
+// How tiles are redistributed
+// Greedy: place the heaviest tiles first, each on the least loaded node
+// Refine: only move tiles off nodes above tolerance * average load
+enum class LBStrategy { Greedy, Refine };
+
+struct LoadBalanceConfig {
+  int interval = 0;   // steps between balancing phases, 0 disables
+  LBStrategy strategy = LBStrategy::Greedy;
+  double tolerance = 1.05;
+};
+
+// Measured work of one tile
+struct TileLoad {
+  TileLoad() = default;
+  TileLoad(int in_tile, int in_node, double in_load) : tile(in_tile), node(in_node), load(in_load) {}
+
+  template <typename SerializerT>
+  void serialize(SerializerT& s) {
+    s | tile | node | load;
+  }
+
+  int tile = 0;
+  int node = 0;
+  double load = 0.;
+};
+
+struct TileLoadPayload {
+  TileLoadPayload() = default;
+
+  friend TileLoadPayload operator+(TileLoadPayload& in1, TileLoadPayload const& in2) {
+    for(auto& elem : in2.loads) {
+      in1.loads.push_back(elem);
+    }
+
+    return in1;
+  }
+
+  template <typename SerializerT>
+  void serialize(SerializerT& s) {
+    s | loads;
+  }
+
+  std::vector<TileLoad> loads;
+};
+
+struct TileLoadMsg : vt::collective::ReduceTMsg<TileLoadPayload> {
+  TileLoadMsg() = default;
+
+  TileLoadMsg(int in_tile, int in_node, double in_load) : vt::collective::ReduceTMsg<TileLoadPayload>() {
+    getVal().loads.emplace_back(in_tile, in_node, in_load);
+  }
+
+  template <typename SerializerT>
+  void serialize(SerializerT& s) {
+    ReduceTMsg<TileLoadPayload>::invokeSerialize(s);
+  }
+};
+
+// Runs on the root once every tile's load has been gathered
+struct LoadBalanceResult {
+  LoadBalanceResult() = default;
+  ~LoadBalanceResult() = default;
+
+  void operator() (TileLoadMsg* msg);
+};
+
+// New node for every tile
+struct LBAssignmentMsg : vt::Message {
+  LBAssignmentMsg() = default;
+
+  template <typename SerializerT>
+  void serialize(SerializerT& s) {
+    s | locations;
+  }
+
+  std::vector<vt::NodeType> locations;
+};
+
+// Periodic redistribution of ParticleMover tiles over the nodes based on
+// the work each tile measured since the last phase. The root gathers the
+// loads, computes the new placement and sends it to every node, which
+// updates its TileMap and migrates away the tiles it no longer owns
+class LoadBalancer {
+  public:
+    LoadBalancer() = default;
+
+    void initialize(const PMProxyType& proxy_, const LoadBalanceConfig& config_);
+
+    // Is a balancing phase due before this step
+    bool isDue(const int step) const;
+
+    // Root only: compute the new placement and send it to every node
+    void balance(std::vector<TileLoad>& loads);
+
+    // Adopt a placement and migrate local tiles that have moved
+    void apply(const std::vector<vt::NodeType>& locations);
+
+  private:
+    std::vector<vt::NodeType> greedy(std::vector<TileLoad>& loads);
+    std::vector<vt::NodeType> refine(std::vector<TileLoad>& loads);
+
+    PMProxyType proxy;
+    LoadBalanceConfig config;
+};
+
+LoadBalancer* theLoadBalancer();
+
+#endif
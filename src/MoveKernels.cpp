@@ -0,0 +1,441 @@
+#include "MoveKernels.hpp"
+
+#if defined(PARTEXCHANGE_SIMD_DISPATCH) && defined(__x86_64__) && defined(__GNUC__)
+#define MOVE_KERNELS_X86 1
+#include <immintrin.h>
+#endif
+
+using SetMovesFn = void (*)(const ParticleColumns&, const int, const int, const CounterKey&, const PoissonTable&);
+using MoveRangeFn = long (*)(const ParticleColumns&, const int, const int, const CounterKey&,
+  const int, const int, int*, int*, int&);
+
+static void setMovesScalar(const ParticleColumns& cols, const int start, const int end, const CounterKey& key, const PoissonTable& table) {
+  const uint32_t k[2] = {key.seed, 0};
+  uint32_t out[4];
+
+  for(int i = start; i < end; i++) {
+    const long slot = static_cast<long>(i) * cols.stride;
+    const uint32_t ctr[4] = {static_cast<uint32_t>(cols.ids[slot]), key.step, 0, crossing_stream};
+    Philox4x32::generate(ctr, k, out);
+    cols.num_moves[slot] = table.sampleBits(out[0]) + 1;
+  }
+}
+
+static long moveRangeScalar(const ParticleColumns& cols, const int start, const int end, const CounterKey& key,
+  const int migrate_chance, const int num_neighbours, int* migrant_idx, int* migrant_neigh, int& num_migrants) {
+  const uint32_t k[2] = {key.seed, 0};
+  uint32_t out[4];
+  long moves = 0;
+
+  for(int i = start; i < end; i++) {
+    const long slot = static_cast<long>(i) * cols.stride;
+    const uint32_t id = cols.ids[slot];
+    int& left = cols.num_moves[slot];
+
+    while(left > 0) {
+      left--;
+      moves++;
+
+      if(left > 0) { // The last move has no crossing to migrate at
+        const uint32_t ctr[4] = {id, key.step, static_cast<uint32_t>(left), move_stream};
+        Philox4x32::generate(ctr, k, out);
+        if(philoxToRange(out[0], 100) < migrate_chance) {
+          cols.deads[slot] = 1;
+          migrant_idx[num_migrants] = i;
+          migrant_neigh[num_migrants] = philoxToRange(out[1], num_neighbours);
+          num_migrants++;
+          break;
+        }
+      }
+    }
+  }
+
+  return moves;
+}
+
+#ifdef MOVE_KERNELS_X86
+
+#define TARGET_AVX2 __attribute__((target("avx2")))
+#define TARGET_AVX512 __attribute__((target("avx512f")))
+
+// AVX2 -----------------------------------------------------------------------
+
+// High and low halves of x * m per 32 bit lane. mul_epu32 only multiplies
+// the even lanes, so the odd lanes go through a second shifted multiply
+TARGET_AVX2 static inline void mulHiLo8(const __m256i x, const __m256i m, __m256i& hi, __m256i& lo) {
+  const __m256i even = _mm256_mul_epu32(x, m);
+  const __m256i odd = _mm256_mul_epu32(_mm256_srli_epi64(x, 32), m);
+  lo = _mm256_blend_epi32(even, _mm256_slli_epi64(odd, 32), 0xAA);
+  hi = _mm256_blend_epi32(_mm256_srli_epi64(even, 32), odd, 0xAA);
+}
+
+TARGET_AVX2 static inline __m256i mulHi8(const __m256i x, const uint32_t m) {
+  __m256i hi, lo;
+  mulHiLo8(x, _mm256_set1_epi32(m), hi, lo);
+  return hi;
+}
+
+// Philox4x32-10 on 8 counters at once, returning the first two words
+TARGET_AVX2 static inline void philox8(__m256i c0, __m256i c1, __m256i c2, __m256i c3, const CounterKey& key, __m256i& o0, __m256i& o1) {
+  const __m256i mul0 = _mm256_set1_epi32(Philox4x32::mul0);
+  const __m256i mul1 = _mm256_set1_epi32(Philox4x32::mul1);
+  uint32_t k0 = key.seed, k1 = 0;
+
+  for(int r = 0; r < Philox4x32::rounds; r++) {
+    __m256i hi0, lo0, hi1, lo1;
+    mulHiLo8(c0, mul0, hi0, lo0);
+    mulHiLo8(c2, mul1, hi1, lo1);
+
+    c0 = _mm256_xor_si256(_mm256_xor_si256(hi1, c1), _mm256_set1_epi32(k0));
+    c1 = lo1;
+    c2 = _mm256_xor_si256(_mm256_xor_si256(hi0, c3), _mm256_set1_epi32(k1));
+    c3 = lo0;
+
+    k0 += Philox4x32::weyl0;
+    k1 += Philox4x32::weyl1;
+  }
+
+  o0 = c0;
+  o1 = c1;
+}
+
+TARGET_AVX2 static inline __m256i load8(const int* base, const int i, const int stride, const __m256i offsets) {
+  if(stride == 1)
+    return _mm256_loadu_si256(reinterpret_cast<const __m256i*>(base + i));
+  return _mm256_i32gather_epi32(base + static_cast<long>(i) * stride, offsets, 4);
+}
+
+// AVX2 has no scatter, so strided columns are written lane by lane
+TARGET_AVX2 static inline void store8(int* base, const int i, const int stride, const __m256i v) {
+  if(stride == 1) {
+    _mm256_storeu_si256(reinterpret_cast<__m256i*>(base + i), v);
+  } else {
+    alignas(32) int lanes[8];
+    _mm256_store_si256(reinterpret_cast<__m256i*>(lanes), v);
+    for(int l = 0; l < 8; l++)
+      base[static_cast<long>(i + l) * stride] = lanes[l];
+  }
+}
+
+// Permutations that pack the selected lanes of an 8 lane vector to the
+// front, indexed by the lane mask
+struct CompressTable {
+  alignas(32) int perm[256][8];
+
+  CompressTable() {
+    for(int mask = 0; mask < 256; mask++) {
+      int n = 0;
+      for(int l = 0; l < 8; l++) {
+        if(mask & (1 << l))
+          perm[mask][n++] = l;
+      }
+      for(; n < 8; n++)
+        perm[mask][n] = 0;
+    }
+  }
+};
+
+static const CompressTable compress_table;
+
+TARGET_AVX2 static void setMovesAVX2(const ParticleColumns& cols, const int start, const int end, const CounterKey& key, const PoissonTable& table) {
+  const __m256i offsets = _mm256_mullo_epi32(_mm256_setr_epi32(0, 1, 2, 3, 4, 5, 6, 7), _mm256_set1_epi32(cols.stride));
+  const __m256i sign = _mm256_set1_epi32(static_cast<int>(0x80000000u));
+  const __m256i num = _mm256_set1_epi32(table.numThresholds());
+  const __m256i base = _mm256_set1_epi32(table.offset() + 1);
+  const int* thresholds = reinterpret_cast<const int*>(table.thresholds().data());
+  const int size = static_cast<int>(table.thresholds().size());
+
+  int i = start;
+  for(; i + 8 <= end; i += 8) {
+    const __m256i ids = load8(cols.ids, i, cols.stride, offsets);
+    __m256i draw, unused;
+    philox8(ids, _mm256_set1_epi32(key.step), _mm256_setzero_si256(), _mm256_set1_epi32(crossing_stream), key, draw, unused);
+
+    // Binary search for the count of thresholds t <= draw, one gather
+    // per level, comparing as unsigned via the sign flip. As in
+    // sampleBits the count is clamped below the padding, then moved past
+    // the table offset and the move that is always made
+    const __m256i biased = _mm256_xor_si256(draw, sign);
+    __m256i pos = _mm256_setzero_si256();
+    for(int level = size / 2; level > 0; level /= 2) {
+      const __m256i idx = _mm256_add_epi32(pos, _mm256_set1_epi32(level - 1));
+      const __m256i t = _mm256_i32gather_epi32(thresholds, idx, 4);
+      const __m256i above = _mm256_cmpgt_epi32(_mm256_xor_si256(t, sign), biased);
+      pos = _mm256_add_epi32(pos, _mm256_andnot_si256(above, _mm256_set1_epi32(level)));
+    }
+    const __m256i moves = _mm256_add_epi32(_mm256_min_epi32(pos, num), base);
+
+    store8(cols.num_moves, i, cols.stride, moves);
+  }
+
+  setMovesScalar(cols, i, end, key, table);
+}
+
+TARGET_AVX2 static long moveRangeAVX2(const ParticleColumns& cols, const int start, const int end, const CounterKey& key,
+  const int migrate_chance, const int num_neighbours, int* migrant_idx, int* migrant_neigh, int& num_migrants) {
+  const __m256i lane_ids = _mm256_setr_epi32(0, 1, 2, 3, 4, 5, 6, 7);
+  const __m256i offsets = _mm256_mullo_epi32(lane_ids, _mm256_set1_epi32(cols.stride));
+  const __m256i zero = _mm256_setzero_si256();
+  const __m256i chance = _mm256_set1_epi32(migrate_chance);
+  const __m256i step = _mm256_set1_epi32(key.step);
+  const __m256i stream = _mm256_set1_epi32(move_stream);
+  long moves = 0;
+
+  int i = start;
+  for(; i + 8 <= end; i += 8) {
+    const __m256i ids = load8(cols.ids, i, cols.stride, offsets);
+    const __m256i initial = load8(cols.num_moves, i, cols.stride, offsets);
+    __m256i left = initial;
+    __m256i migrated = zero;
+    __m256i neigh = zero;
+
+    // Step every lane through its moves together until each one has
+    // either run out or migrated
+    while(true) {
+      const __m256i active = _mm256_andnot_si256(migrated, _mm256_cmpgt_epi32(left, zero));
+      if(_mm256_testz_si256(active, active))
+        break;
+
+      left = _mm256_add_epi32(left, active);
+
+      const __m256i rolling = _mm256_and_si256(active, _mm256_cmpgt_epi32(left, zero));
+      if(_mm256_testz_si256(rolling, rolling))
+        continue;
+
+      __m256i roll_bits, neigh_bits;
+      philox8(ids, step, left, stream, key, roll_bits, neigh_bits);
+      const __m256i migrate = _mm256_and_si256(rolling, _mm256_cmpgt_epi32(chance, mulHi8(roll_bits, 100)));
+
+      neigh = _mm256_blendv_epi8(neigh, mulHi8(neigh_bits, num_neighbours), migrate);
+      migrated = _mm256_or_si256(migrated, migrate);
+    }
+
+    store8(cols.num_moves, i, cols.stride, left);
+
+    alignas(32) int made[8];
+    _mm256_store_si256(reinterpret_cast<__m256i*>(made), _mm256_sub_epi32(initial, left));
+    for(int l = 0; l < 8; l++)
+      moves += made[l];
+
+    // Pack the migrating lanes to the front and store the full registers;
+    // only the packed entries are counted
+    const int mask = _mm256_movemask_ps(_mm256_castsi256_ps(migrated));
+    if(mask) {
+      const __m256i perm = _mm256_load_si256(reinterpret_cast<const __m256i*>(compress_table.perm[mask]));
+      const __m256i idx = _mm256_add_epi32(_mm256_set1_epi32(i), lane_ids);
+      _mm256_storeu_si256(reinterpret_cast<__m256i*>(migrant_idx + num_migrants), _mm256_permutevar8x32_epi32(idx, perm));
+      _mm256_storeu_si256(reinterpret_cast<__m256i*>(migrant_neigh + num_migrants), _mm256_permutevar8x32_epi32(neigh, perm));
+
+      for(int l = 0; l < 8; l++) {
+        if(mask & (1 << l))
+          cols.deads[static_cast<long>(i + l) * cols.stride] = 1;
+      }
+      num_migrants += __builtin_popcount(mask);
+    }
+  }
+
+  return moves + moveRangeScalar(cols, i, end, key, migrate_chance, num_neighbours, migrant_idx, migrant_neigh, num_migrants);
+}
+
+// AVX-512 --------------------------------------------------------------------
+
+TARGET_AVX512 static inline void mulHiLo16(const __m512i x, const __m512i m, __m512i& hi, __m512i& lo) {
+  const __m512i even = _mm512_mul_epu32(x, m);
+  const __m512i odd = _mm512_mul_epu32(_mm512_srli_epi64(x, 32), m);
+  lo = _mm512_mask_blend_epi32(0xAAAA, even, _mm512_slli_epi64(odd, 32));
+  hi = _mm512_mask_blend_epi32(0xAAAA, _mm512_srli_epi64(even, 32), odd);
+}
+
+TARGET_AVX512 static inline __m512i mulHi16(const __m512i x, const uint32_t m) {
+  __m512i hi, lo;
+  mulHiLo16(x, _mm512_set1_epi32(m), hi, lo);
+  return hi;
+}
+
+TARGET_AVX512 static inline void philox16(__m512i c0, __m512i c1, __m512i c2, __m512i c3, const CounterKey& key, __m512i& o0, __m512i& o1) {
+  const __m512i mul0 = _mm512_set1_epi32(Philox4x32::mul0);
+  const __m512i mul1 = _mm512_set1_epi32(Philox4x32::mul1);
+  uint32_t k0 = key.seed, k1 = 0;
+
+  for(int r = 0; r < Philox4x32::rounds; r++) {
+    __m512i hi0, lo0, hi1, lo1;
+    mulHiLo16(c0, mul0, hi0, lo0);
+    mulHiLo16(c2, mul1, hi1, lo1);
+
+    c0 = _mm512_xor_si512(_mm512_xor_si512(hi1, c1), _mm512_set1_epi32(k0));
+    c1 = lo1;
+    c2 = _mm512_xor_si512(_mm512_xor_si512(hi0, c3), _mm512_set1_epi32(k1));
+    c3 = lo0;
+
+    k0 += Philox4x32::weyl0;
+    k1 += Philox4x32::weyl1;
+  }
+
+  o0 = c0;
+  o1 = c1;
+}
+
+TARGET_AVX512 static inline __m512i load16(const int* base, const int i, const int stride, const __m512i offsets) {
+  if(stride == 1)
+    return _mm512_loadu_si512(base + i);
+  return _mm512_i32gather_epi32(offsets, base + static_cast<long>(i) * stride, 4);
+}
+
+TARGET_AVX512 static inline void store16(int* base, const int i, const int stride, const __m512i offsets, const __mmask16 mask, const __m512i v) {
+  if(stride == 1)
+    _mm512_mask_storeu_epi32(base + i, mask, v);
+  else
+    _mm512_mask_i32scatter_epi32(base + static_cast<long>(i) * stride, mask, offsets, v, 4);
+}
+
+TARGET_AVX512 static void setMovesAVX512(const ParticleColumns& cols, const int start, const int end, const CounterKey& key, const PoissonTable& table) {
+  const __m512i offsets = _mm512_mullo_epi32(_mm512_setr_epi32(0, 1, 2, 3, 4, 5, 6, 7, 8, 9, 10, 11, 12, 13, 14, 15), _mm512_set1_epi32(cols.stride));
+  const __m512i num = _mm512_set1_epi32(table.numThresholds());
+  const __m512i base = _mm512_set1_epi32(table.offset() + 1);
+  const int* thresholds = reinterpret_cast<const int*>(table.thresholds().data());
+  const int size = static_cast<int>(table.thresholds().size());
+
+  int i = start;
+  for(; i + 16 <= end; i += 16) {
+    const __m512i ids = load16(cols.ids, i, cols.stride, offsets);
+    __m512i draw, unused;
+    philox16(ids, _mm512_set1_epi32(key.step), _mm512_setzero_si512(), _mm512_set1_epi32(crossing_stream), key, draw, unused);
+
+    // Same gather binary search as the AVX2 kernel
+    __m512i pos = _mm512_setzero_si512();
+    for(int level = size / 2; level > 0; level /= 2) {
+      const __m512i idx = _mm512_add_epi32(pos, _mm512_set1_epi32(level - 1));
+      const __m512i t = _mm512_i32gather_epi32(idx, thresholds, 4);
+      const __mmask16 reached = _mm512_cmpge_epu32_mask(draw, t);
+      pos = _mm512_mask_add_epi32(pos, reached, pos, _mm512_set1_epi32(level));
+    }
+    const __m512i moves = _mm512_add_epi32(_mm512_min_epi32(pos, num), base);
+
+    store16(cols.num_moves, i, cols.stride, offsets, 0xFFFF, moves);
+  }
+
+  setMovesScalar(cols, i, end, key, table);
+}
+
+TARGET_AVX512 static long moveRangeAVX512(const ParticleColumns& cols, const int start, const int end, const CounterKey& key,
+  const int migrate_chance, const int num_neighbours, int* migrant_idx, int* migrant_neigh, int& num_migrants) {
+  const __m512i lane_ids = _mm512_setr_epi32(0, 1, 2, 3, 4, 5, 6, 7, 8, 9, 10, 11, 12, 13, 14, 15);
+  const __m512i offsets = _mm512_mullo_epi32(lane_ids, _mm512_set1_epi32(cols.stride));
+  const __m512i zero = _mm512_setzero_si512();
+  const __m512i one = _mm512_set1_epi32(1);
+  const __m512i chance = _mm512_set1_epi32(migrate_chance);
+  const __m512i step = _mm512_set1_epi32(key.step);
+  const __m512i stream = _mm512_set1_epi32(move_stream);
+  long moves = 0;
+
+  int i = start;
+  for(; i + 16 <= end; i += 16) {
+    const __m512i ids = load16(cols.ids, i, cols.stride, offsets);
+    const __m512i initial = load16(cols.num_moves, i, cols.stride, offsets);
+    __m512i left = initial;
+    __m512i neigh = zero;
+    __mmask16 migrated = 0;
+
+    while(true) {
+      const __mmask16 active = _mm512_cmpgt_epi32_mask(left, zero) & ~migrated;
+      if(!active)
+        break;
+
+      left = _mm512_mask_sub_epi32(left, active, left, one);
+
+      const __mmask16 rolling = active & _mm512_cmpgt_epi32_mask(left, zero);
+      if(!rolling)
+        continue;
+
+      __m512i roll_bits, neigh_bits;
+      philox16(ids, step, left, stream, key, roll_bits, neigh_bits);
+      const __mmask16 migrate = rolling & _mm512_cmplt_epi32_mask(mulHi16(roll_bits, 100), chance);
+
+      neigh = _mm512_mask_mov_epi32(neigh, migrate, mulHi16(neigh_bits, num_neighbours));
+      migrated |= migrate;
+    }
+
+    store16(cols.num_moves, i, cols.stride, offsets, 0xFFFF, left);
+    moves += _mm512_reduce_add_epi32(_mm512_sub_epi32(initial, left));
+
+    if(migrated) {
+      const __m512i idx = _mm512_add_epi32(_mm512_set1_epi32(i), lane_ids);
+      _mm512_mask_compressstoreu_epi32(migrant_idx + num_migrants, migrated, idx);
+      _mm512_mask_compressstoreu_epi32(migrant_neigh + num_migrants, migrated, neigh);
+      store16(cols.deads, i, cols.stride, offsets, migrated, one);
+      num_migrants += __builtin_popcount(migrated);
+    }
+  }
+
+  return moves + moveRangeScalar(cols, i, end, key, migrate_chance, num_neighbours, migrant_idx, migrant_neigh, num_migrants);
+}
+
+#endif
+
+struct KernelTable {
+  SetMovesFn set_moves;
+  MoveRangeFn move_range;
+  const char* isa;
+};
+
+static KernelTable selectKernels() {
+#ifdef MOVE_KERNELS_X86
+  __builtin_cpu_init();
+  if(__builtin_cpu_supports("avx512f"))
+    return {setMovesAVX512, moveRangeAVX512, "AVX-512"};
+  if(__builtin_cpu_supports("avx2"))
+    return {setMovesAVX2, moveRangeAVX2, "AVX2"};
+#endif
+  return {setMovesScalar, moveRangeScalar, "scalar"};
+}
+
+static const KernelTable& kernels() {
+  static const KernelTable table = selectKernels();
+  return table;
+}
+
+void counterSetMoves(const ParticleColumns& cols, const int start, const int end, const CounterKey& key, const PoissonTable& table) {
+  kernels().set_moves(cols, start, end, key, table);
+}
+
+long counterMoveRange(const ParticleColumns& cols, const int start, const int end, const CounterKey& key,
+  const int migrate_chance, const int num_neighbours, int* migrant_idx, int* migrant_neigh, int& num_migrants) {
+  return kernels().move_range(cols, start, end, key, migrate_chance, num_neighbours, migrant_idx, migrant_neigh, num_migrants);
+}
+
+long counterMoveRangeClosedForm(const ParticleColumns& cols, const int start, const int end, const CounterKey& key,
+  const double log_stay, const int num_neighbours, int* migrant_idx, int* migrant_neigh, int& num_migrants) {
+  const uint32_t k[2] = {key.seed, 0};
+  uint32_t out[4];
+  long moves = 0;
+
+  for(int i = start; i < end; i++) {
+    const long slot = static_cast<long>(i) * cols.stride;
+    int& left = cols.num_moves[slot];
+
+    // The moves left tell apart the hops a particle makes within a step,
+    // as in the loop kernel; (x + 1) / 2^32 lies in (0, 1], so the log is
+    // finite
+    const uint32_t ctr[4] = {static_cast<uint32_t>(cols.ids[slot]), key.step, static_cast<uint32_t>(left), closed_form_stream};
+    Philox4x32::generate(ctr, k, out);
+    const double u = (static_cast<double>(out[0]) + 1.) * (1.0 / 4294967296.0);
+
+    int made;
+    const bool migrate = closedFormMove(left, u, log_stay, made);
+    left -= made;
+    moves += made;
+
+    if(migrate) {
+      cols.deads[slot] = 1;
+      migrant_idx[num_migrants] = i;
+      migrant_neigh[num_migrants] = philoxToRange(out[1], num_neighbours);
+      num_migrants++;
+    }
+  }
+
+  return moves;
+}
+
+const char* moveKernelISA() {
+  return kernels().isa;
+}
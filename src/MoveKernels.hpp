@@ -0,0 +1,81 @@
+#ifndef MOVE_KERNELS_HPP
+#define MOVE_KERNELS_HPP
+#include "CounterRNG.hpp"
+#include <cstdint>
+#include <cmath>
+#include <algorithm>
+
+// Batched kernels for the counter RNG mode. Every draw is a pure function
+// of its key, so blocks of particles are resolved together in SIMD lanes.
+// The instruction set is picked once at startup from what the CPU
+// supports (AVX-512, AVX2 or scalar); all of them give identical results
+
+// Last word of the Philox counter, so crossing counts and move rolls never
+// share a draw
+constexpr uint32_t crossing_stream = 0;
+constexpr uint32_t move_stream = 1;
+constexpr uint32_t closed_form_stream = 2;
+
+// Extra entries the migrant output arrays need past the particle count,
+// as vector stores write whole registers
+constexpr int simd_slack = 16;
+
+// Hot particle fields as strided int columns. SoA columns are dense, AoS
+// columns step over whole Particle records. Kept free of the particle
+// types so the kernels build on their own
+struct ParticleColumns {
+  int* ids;
+  int* num_moves;
+  int* deads;
+  int stride;
+};
+
+// log(1 - p) of a per-roll migration chance in percent
+inline double migrateLogStay(const int migrate_chance) {
+  const double p = std::min(std::max(migrate_chance / 100., 0.), 1.);
+  return std::log1p(-p);
+}
+
+// Closed form of the move loop for a particle with num_moves moves left,
+// from one uniform draw u in (0, 1]. The loop rolls after every move but
+// the last, so the first successful roll is geometric and the particle
+// migrates when it comes within num_moves - 1 rolls. Sets the number of
+// moves made and returns whether the particle migrates
+inline bool closedFormMove(const int num_moves, const double u, const double log_stay, int& moves_made) {
+  if(num_moves > 1 && log_stay < 0.) {
+    const double first = std::isinf(log_stay) ? 1. : std::ceil(std::log(u) / log_stay);
+    if(first < num_moves) {
+      moves_made = first < 1. ? 1 : static_cast<int>(first);
+      return true;
+    }
+  }
+
+  moves_made = num_moves > 0 ? num_moves : 0;
+  return false;
+}
+
+// Key of the counter RNG draws made in one step
+struct CounterKey {
+  uint32_t seed;
+  uint32_t step;
+};
+
+// Set num_moves to a Poisson crossing count + 1 for particles [start, end)
+void counterSetMoves(const ParticleColumns& cols, const int start, const int end, const CounterKey& key, const PoissonTable& table);
+
+// Resolve every move of particles [start, end). Migrating particles are
+// flagged dead, and their indices and neighbour choices are written in
+// index order to migrant_idx and migrant_neigh, which need room for
+// end - start + simd_slack entries. Returns the number of moves made
+long counterMoveRange(const ParticleColumns& cols, const int start, const int end, const CounterKey& key,
+  const int migrate_chance, const int num_neighbours, int* migrant_idx, int* migrant_neigh, int& num_migrants);
+
+// counterMoveRange with one closed form draw per particle. Scalar only;
+// the cost no longer depends on the number of moves
+long counterMoveRangeClosedForm(const ParticleColumns& cols, const int start, const int end, const CounterKey& key,
+  const double log_stay, const int num_neighbours, int* migrant_idx, int* migrant_neigh, int& num_migrants);
+
+// Instruction set the kernels dispatched to
+const char* moveKernelISA();
+
+#endif
@@ -0,0 +1,82 @@
+#ifndef MOVER_CONFIG_HPP
+#define MOVER_CONFIG_HPP
+
+// Coalescing of incoming migrations. When enabled a tile buffers the
+// particles it receives and runs a single move-and-send pass once one of
+// the thresholds is reached, or once the scheduler has drained the
+// messages that were already queued for it. A threshold of 0 is unlimited
+struct AggregationConfig {
+  bool enabled = false;
+  int max_messages = 0;
+  int max_particles = 0;
+  double max_wait_us = 0.;
+
+  template <typename SerializerT>
+  void serialize(SerializerT& s) {
+    s | enabled | max_messages | max_particles | max_wait_us;
+  }
+};
+
+// Node level aggregation of tile to tile migration. Batches for tiles on
+// the same remote node are sent as one message per flush; batches for
+// tiles on this node are handed over directly. max_bytes forces an early
+// flush of a node's buffer, 0 is unlimited
+struct NodeAggregationConfig {
+  bool enabled = false;
+  long max_bytes = 0;
+
+  template <typename SerializerT>
+  void serialize(SerializerT& s) {
+    s | enabled | max_bytes;
+  }
+};
+
+// Source of the random decisions in a move. Mersenne draws from per-tile
+// engines in processing order. Counter makes every crossing count,
+// migration roll and destination a Philox draw keyed on the seed, particle
+// id, step and remaining moves, so runs reproduce regardless of tile
+// count, message arrival order or threading
+enum class RNGMode {Mersenne, Counter};
+
+struct RNGConfig {
+  RNGMode mode = RNGMode::Mersenne;
+  int seed = 0;
+
+  template <typename SerializerT>
+  void serialize(SerializerT& s) {
+    int mode_id = static_cast<int>(mode);
+    s | mode_id | seed;
+    mode = static_cast<RNGMode>(mode_id);
+  }
+};
+
+// How the move kernel resolves a particle. Loop takes its moves one at a
+// time with a migration roll after each. ClosedForm draws the geometric
+// number of moves until the first successful roll once, so the cost does
+// not grow with the crossing count; the outcomes have the same
+// distribution as Loop but come from different draws
+enum class MoveKernelMode {Loop, ClosedForm};
+
+// Tuning options for a ParticleMover that come from the input deck.
+// move_threads splits each move kernel call over that many threads of the
+// process-wide pool, 1 keeps the serial kernel. stable_compaction keeps
+// the particles that stay in their memory order when migrants leave
+struct MoverConfig {
+  AggregationConfig aggregation;
+  NodeAggregationConfig node_aggregation;
+  int move_threads = 1;
+  RNGConfig rng;
+  MoveKernelMode kernel = MoveKernelMode::Loop;
+  bool stable_compaction = false;
+
+  template <typename SerializerT>
+  void serialize(SerializerT& s) {
+    s | aggregation | node_aggregation | move_threads | rng | stable_compaction;
+
+    int kernel_id = static_cast<int>(kernel);
+    s | kernel_id;
+    kernel = static_cast<MoveKernelMode>(kernel_id);
+  }
+};
+
+#endif
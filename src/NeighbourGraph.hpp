@@ -0,0 +1,25 @@
+#ifndef NEIGHBOUR_GRAPH_HPP
+#define NEIGHBOUR_GRAPH_HPP
+#include <vector>
+
+// How the neighbour graph is built
+// Global: every rank builds the whole graph
+// Distributed: every rank only works out the rows of the tiles it owns
+enum class GraphGeneration { Global, Distributed };
+
+// Shape of the neighbour graph
+// Random: random edges up to an average degree, no spatial locality
+// Mesh2D/Mesh3D: Cartesian grid with a 4/8 or 6/26 point stencil
+// Torus2D/Torus3D: as the meshes, with periodic wrap around
+enum class Topology { Random, Mesh2D, Mesh3D, Torus2D, Torus3D };
+
+// Graph with tiles as nodes and neighbours linked by edges
+class NeighbourGraph {
+  public:
+    virtual ~NeighbourGraph() = default;
+
+    // Neighbours of a node, in ascending order
+    virtual const std::vector<int> getNodeNeighbours(const int node) = 0;
+};
+
+#endif
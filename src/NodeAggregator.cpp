@@ -0,0 +1,109 @@
+#include "NodeAggregator.hpp"
+
+#include "Trace.hpp"
+
+#include <algorithm>
+
+static void aggregatedParticleHandler(AggregatedParticleMsg* msg) {
+  TRACE_SCOPE("aggregatedParticleHandler", -1);
+  TRACE_RECV("batchRecv", -1, msg->batch.source, msg->batch.particles.size(), msg->batch.particles.size() * sizeof(Particle));
+  theNodeAggregator()->deliver(msg->batch);
+}
+
+static void nodeFlushHandler(NodeFlushMsg* msg) {
+  theNodeAggregator()->flush();
+}
+
+NodeAggregator* theNodeAggregator() {
+  static NodeAggregator aggregator;
+  return &aggregator;
+}
+
+void NodeAggregator::initialize(const PMProxyType& proxy_, const long max_bytes_) {
+  proxy = proxy_;
+  max_bytes = max_bytes_;
+  batches.resize(vt::theContext()->getNumNodes());
+}
+
+void NodeAggregator::send(const int tile, std::vector<Particle>&& parts, const int step) {
+  const vt::NodeType me = vt::theContext()->getNode();
+  const vt::NodeType to = TileMap::node(tile);
+
+  if(to == me) {
+    auto local = proxy[tile].tryGetLocalPtr();
+    if(local != nullptr) {
+      local->receiveLocal(std::move(parts), step);
+      return;
+    }
+
+    // Not resident after all, let vt find it
+    auto msg = vt::makeSharedMessage<ParticleMover::ParticleMsg>();
+    msg->particles = std::move(parts);
+    msg->step = step;
+    proxy[tile].send<ParticleMover::ParticleMsg, &ParticleMover::particleMigrationHandler>(msg);
+    return;
+  }
+
+  auto& batch = batches[to];
+  batch.tiles.push_back(tile);
+  batch.counts.push_back(parts.size());
+  batch.steps.push_back(step);
+  batch.particles.insert(batch.particles.end(), parts.begin(), parts.end());
+
+  if(max_bytes > 0 && static_cast<long>(batch.particles.size() * sizeof(Particle)) >= max_bytes) {
+    flushNode(to);
+  } else if(!flush_scheduled) {
+    // Flush once everything already queued on this node has run, so all
+    // tiles that are about to send get into the same batch
+    flush_scheduled = true;
+    auto msg = vt::makeSharedMessage<NodeFlushMsg>();
+    vt::theMsg()->sendMsg<NodeFlushMsg, nodeFlushHandler>(me, msg);
+  }
+}
+
+void NodeAggregator::flush() {
+  flush_scheduled = false;
+
+  for(int node = 0; node < batches.size(); node++) {
+    if(!batches[node].tiles.empty())
+      flushNode(node);
+  }
+}
+
+void NodeAggregator::flushNode(const vt::NodeType node) {
+  auto msg = vt::makeSharedMessage<AggregatedParticleMsg>();
+  std::swap(msg->batch, batches[node]);
+  batches[node].clear();
+  msg->batch.source = vt::theContext()->getNode();
+
+  TRACE_SEND("batchSend", -1, node, msg->batch.particles.size(), msg->batch.particles.size() * sizeof(Particle));
+
+#if 0
+  fmt::print("Node {} flushing {} segments to node {}\n", vt::theContext()->getNode(), msg->batch.tiles.size(), node);
+#endif
+  vt::theMsg()->sendMsg<AggregatedParticleMsg, aggregatedParticleHandler>(node, msg);
+}
+
+void NodeAggregator::deliver(NodeBatch& batch) {
+  int offset = 0;
+
+  for(int i = 0; i < batch.tiles.size(); i++) {
+    const int tile = batch.tiles[i];
+    const int count = batch.counts[i];
+    const int step = batch.steps[i];
+    const Particle* parts = batch.particles.data() + offset;
+
+    auto local = proxy[tile].tryGetLocalPtr();
+    if(local != nullptr) {
+      local->receiveLocal(parts, count, step);
+    } else {
+      // Tile has moved away from here, forward it on
+      auto msg = vt::makeSharedMessage<ParticleMover::ParticleMsg>();
+      msg->particles.assign(parts, parts + count);
+      msg->step = step;
+      proxy[tile].send<ParticleMover::ParticleMsg, &ParticleMover::particleMigrationHandler>(msg);
+    }
+
+    offset += count;
+  }
+}
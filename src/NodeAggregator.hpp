@@ -0,0 +1,75 @@
+#ifndef NODE_AGGREGATOR_HPP
+#define NODE_AGGREGATOR_HPP
+#include "Particle.hpp"
+#include "ParticleMover.hpp"
+#include "TileMap.hpp"
+
+#include <vt/transport.h>
+#include <vector>
+
+using PMProxyType = vt::vrt::collection::CollectionProxy<ParticleMover, IndexType>;
+
+// All particle batches bound for tiles on one node, packed back to back.
+// Segment i holds counts[i] particles for tile tiles[i], sent during the
+// sender's step steps[i]
+struct NodeBatch {
+  vt::NodeType source = 0;
+  std::vector<int> tiles;
+  std::vector<int> counts;
+  std::vector<int> steps;
+  std::vector<Particle> particles;
+
+  void clear() {
+    tiles.clear();
+    counts.clear();
+    steps.clear();
+    particles.clear();
+  }
+};
+
+struct AggregatedParticleMsg : vt::Message {
+  AggregatedParticleMsg() = default;
+
+  template <typename SerializerT>
+  void serialize(SerializerT& s) {
+    s | batch.source | batch.tiles | batch.counts | batch.steps;
+    serializeParticleBatch(s, batch.particles);
+  }
+
+  NodeBatch batch;
+};
+
+struct NodeFlushMsg : vt::Message {};
+
+// Per node aggregation layer for tile to tile migration. Batches bound for
+// tiles on a remote node are packed into a single transport message per
+// flush and unpacked to the tiles on arrival. Batches for tiles on this
+// node are handed straight to the tile, with no message or serialization
+class NodeAggregator {
+  public:
+    NodeAggregator() = default;
+
+    void initialize(const PMProxyType& proxy_, const long max_bytes_);
+
+    // Route a batch of particles sent during step to a tile
+    void send(const int tile, std::vector<Particle>&& parts, const int step);
+
+    // Send everything buffered for remote nodes
+    void flush();
+
+    // Hand the segments of an arrived batch to their tiles
+    void deliver(NodeBatch& batch);
+
+  private:
+    // Send the buffered batch for one node
+    void flushNode(const vt::NodeType node);
+
+    PMProxyType proxy;
+    long max_bytes = 0;
+    std::vector<NodeBatch> batches;
+    bool flush_scheduled = false;
+};
+
+NodeAggregator* theNodeAggregator();
+
+#endif
@@ -1,10 +1,9 @@
 #include "OutputWriter.hpp"
 
 #include <algorithm>
-#include <fmt/core.h>
-#include "yaml-cpp/yaml.h"
+#include <fmt/format.h>
 
-OutputWriter::OutputWriter(const std::string& fname_) {
+OutputWriter::OutputWriter(const std::string& fname_, const OutputFormat format_) : format(format_) {
   if(fname_.empty()) {
     outfile.open("output.out.yaml");
   } else {
@@ -17,36 +16,94 @@ OutputWriter::~OutputWriter() {
 }
 
 void OutputWriter::writeStatistics(const std::string& name, const std::vector<double>& data) {
-  double average, total = 0.; 
-  double max = -1e99;
-  double min = 1e99;
-
-  for(auto& d : data) {
-    total += d;
-    min = std::min(min, d); 
-    max = std::max(max, d); 
+  StreamingStats stats;
+  for(auto& d : data)
+    stats.push(d);
+
+  writeStatistics(name, stats);
+}
+
+// Quantiles reported when the stats carry a sketch
+static const double report_quantiles[] = {0.5, 0.95, 0.99};
+static const char* report_quantile_names[] = {"P50", "P95", "P99"};
+
+static void appendCSV(std::string& out, const StreamingStats& stats) {
+  out += fmt::format(",{:.5f},{:.5f},{:.5f},{:.5f}", stats.min(), stats.mean(), stats.max(), stats.stdev());
+  if(stats.hasQuantiles()) {
+    for(auto q : report_quantiles)
+      out += fmt::format(",{:.5f}", stats.quantile(q));
   }
+  out += "\n";
+}
+
+static void appendYAML(std::string& out, const std::string& indent, const StreamingStats& stats) {
+  out += fmt::format("{}Min: {:.5f}\n", indent, stats.min());
+  out += fmt::format("{}Average: {:.5f}\n", indent, stats.mean());
+  out += fmt::format("{}Max: {:.5f}\n", indent, stats.max());
+  out += fmt::format("{}StDev: {:.5f}\n", indent, stats.stdev());
+  if(stats.hasQuantiles()) {
+    for(int i = 0; i < 3; i++)
+      out += fmt::format("{}{}: {:.5f}\n", indent, report_quantile_names[i], stats.quantile(report_quantiles[i]));
+  }
+}
+
+void OutputWriter::writeHeader(const std::string& prefix, const bool quantiles) {
+  if(header_written)
+    return;
 
-  average = total / data.size();
+  outfile << prefix << "min,average,max,stdev";
+  if(quantiles)
+    outfile << ",p50,p95,p99";
+  outfile << std::endl;
 
-  double sum_devs = 0.; 
-  for(auto& d : data) {
-    sum_devs += pow((d - average), 2); 
+  header_written = true;
+}
+
+void OutputWriter::writeStatistics(const std::string& name, const StreamingStats& stats) {
+  std::string out;
+
+  if(format == OutputFormat::CSV) {
+    writeHeader("name,", stats.hasQuantiles());
+    out += name;
+    appendCSV(out, stats);
+  } else {
+    out += fmt::format("{}:\n", name);
+    appendYAML(out, "  ", stats);
+    out += "\n";
   }
 
-  sum_devs /= data.size();
-  double stdev = sqrt(sum_devs);
+  outfile.write(out.data(), out.size());
+}
+
+void OutputWriter::writeSteps(const int first_step, const std::vector<std::string>& names, const std::vector<StreamingStats>& stats) {
+  const int num_names = names.size();
+  if(num_names == 0 || stats.empty())
+    return;
 
-  YAML::Node parent;
-  YAML::Node dataNode;
+  const int num_steps = stats.size() / num_names;
+  std::string out;
 
-  dataNode["Min"] = fmt::format("{:.5f}", min);
-  dataNode["Average"] = fmt::format("{:.5f}", average);
-  dataNode["Max"] = fmt::format("{:.5f}", max);
-  dataNode["StDev"] = fmt::format("{:.5f}", stdev);
+  if(format == OutputFormat::CSV)
+    writeHeader("step,name,", stats.front().hasQuantiles());
 
-  parent[name] = dataNode;
+  for(int i = 0; i < num_steps; i++) {
+    const int step = first_step + i;
+
+    if(format == OutputFormat::CSV) {
+      for(int m = 0; m < num_names; m++) {
+        out += fmt::format("{},{}", step, names[m]);
+        appendCSV(out, stats[i * num_names + m]);
+      }
+    } else {
+      out += fmt::format("Step {}:\n", step);
+      for(int m = 0; m < num_names; m++) {
+        out += fmt::format("  {}:\n", names[m]);
+        appendYAML(out, "    ", stats[i * num_names + m]);
+      }
+      out += "\n";
+    }
+  }
 
-  outfile << parent;
-  outfile << std::endl << std::endl;
+  outfile.write(out.data(), out.size());
+  outfile.flush();
 }
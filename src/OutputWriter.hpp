@@ -1,22 +1,38 @@
 #ifndef OUTPUT_WRITER_HPP
 #define OUTPUT_WRITER_HPP
 
+#include "StreamingStats.hpp"
+
 #include <fstream>
 #include <iostream>
 #include <string>
 #include <vector>
 
+enum class OutputFormat { YAML, CSV };
+
 class OutputWriter {
   public:
     OutputWriter() = delete;
-    OutputWriter(const std::string& fname_);
+    OutputWriter(const std::string& fname_, const OutputFormat format_ = OutputFormat::YAML);
 
     void writeStatistics(const std::string& name, const std::vector<double>& data);
 
+    void writeStatistics(const std::string& name, const StreamingStats& stats);
+
+    // A batch of consecutive steps, starting at first_step. stats holds
+    // names.size() entries per step, in the order of names. The batch is
+    // formatted in memory and written at once
+    void writeSteps(const int first_step, const std::vector<std::string>& names, const std::vector<StreamingStats>& stats);
+
     ~OutputWriter();
   
   private:
+    // Column names, written before the first CSV row
+    void writeHeader(const std::string& prefix, const bool quantiles);
+
     std::ofstream outfile;
+    OutputFormat format;
+    bool header_written = false;
 };
 
 #endif
@@ -6,6 +6,8 @@
 #include <random>
 #include <cmath>
 #include <string>
+#include <memory>
+#include <functional>
 
 #include "yaml-cpp/yaml.h"
 
@@ -14,19 +16,104 @@
 #include "ParticleMover.hpp"
 #include "OutputWriter.hpp"
 #include "GraphGenerator.hpp"
+#include "DistributedGraphGenerator.hpp"
+#include "StencilGraph.hpp"
+#include "TileMap.hpp"
+#include "NodeAggregator.hpp"
+#include "LoadBalancer.hpp"
+#include "WorkModel.hpp"
+#include "ThreadPool.hpp"
+#include "MoveKernels.hpp"
+#include "Trace.hpp"
+#include "Checkpoint.hpp"
+
+#include <unistd.h>
+#include <mpi.h>
+#include <cassert>
 
 using IndexType = vt::IdxType1D<std::size_t>;
 using PMProxyType = vt::vrt::collection::CollectionProxy<ParticleMover, IndexType>;
 
 static double total_time, start = 0.0;
+static bool report_buffer_growth = false;
+static StepConfig step_config;
+static std::string tile_dump_file;
+static CheckpointConfig checkpoint_config;
 
 // Forward declare these so we can use in term calls
+void startStep(int step, int num_steps, PMProxyType& proxy);
 void initStep(int step, int num_steps, PMProxyType& proxy);
 void executeStep(int step, int num_steps, PMProxyType& proxy);
+void pipelineStep(int step, int num_steps, PMProxyType& proxy);
+void balanceStep(int step, int num_steps, PMProxyType& proxy);
+void finishRun(PMProxyType& proxy);
+void writeTileDump(PMProxyType& proxy);
+
+// Whether a checkpoint is taken before step
+bool checkpointDue(int step) {
+  return checkpoint_config.interval > 0 && step > 0 && step % checkpoint_config.interval == 0;
+}
+
+// Take the checkpoint due before next_step, if any, in its own epoch, then
+// carry on with then. Called on every node between steps, once all tiles
+// are done with the step before next_step
+void checkpointThen(int next_step, PMProxyType& proxy, std::function<void()> then) {
+  if(!checkpointDue(next_step)) {
+    then();
+    return;
+  }
+
+  const auto path = checkpointPath(checkpoint_config.prefix, next_step);
+  auto epoch = vt::theTerm()->makeEpochCollective();
+
+  vt::theTerm()->addAction(epoch, [path, next_step, then]{
+    if(vt::theContext()->getNode() == 0) {
+      if(takeCheckpointResult())
+        fmt::print("Wrote checkpoint {} before step {}\n", path, next_step);
+      else
+        fmt::print("Failed to write checkpoint {} before step {}, carrying on without it\n", path, next_step);
+    }
+
+    then();
+  });
+
+  startCheckpoint(path, next_step, proxy, epoch);
+
+  vt::theTerm()->finishedEpoch(epoch);
+}
+
+// Call handler on every tile as part of epoch, with a MsgT built from args.
+// Every node takes part, as epochs are collective
+template <typename MsgT, void (ParticleMover::*handler)(MsgT*), typename... Args>
+void startTiles(vt::EpochType epoch, PMProxyType& proxy, Args... args) {
+  auto me = vt::theContext()->getNode();
+
+  if(step_config.start == StepStart::Local) {
+    // Anything the handlers send belongs to the epoch
+    vt::theMsg()->pushEpoch(epoch);
+    for(auto& tile : TileMap::localTiles(me)) {
+      auto local = proxy[tile].tryGetLocalPtr();
+      if(local != nullptr) {
+        MsgT msg(args...);
+        (local->*handler)(&msg);
+      } else {
+        // Not here after all, so let vt deliver it wherever it is
+        auto msg = vt::makeSharedMessage<MsgT>(args...);
+        vt::envelopeSetEpoch(msg->env, epoch);
+        proxy[tile].template send<MsgT, handler>(msg);
+      }
+    }
+    vt::theMsg()->popEpoch(epoch);
+  } else if(me == 0) {
+    auto msg = vt::makeSharedMessage<MsgT>(args...);
+    vt::envelopeSetEpoch(msg->env, epoch);
+    proxy.template broadcast<MsgT, handler>(msg);
+  }
+}
 
 // "Normally" distribute  particles over ranks. Return a vector containing counts for
-// each rank we are using
-std::vector<int> distributeParticles(const int nparticles, const int nranks, const int overdecompose, const double stdev,
+// each tile, split evenly over the tiles that live on each rank
+std::vector<int> distributeParticles(const int nparticles, const int nranks, const double stdev,
   const int rng_seed) {
 
   std::vector<int> rank_counts;
@@ -56,63 +143,141 @@ std::vector<int> distributeParticles(const int nparticles, const int nranks, con
     max_allowed -= amount;
   }
 
-  const int ntiles = nranks * overdecompose;
+  // Split each rank's share over the tiles the TileMap places on it
+  const int ntiles = TileMap::numTiles();
+  std::vector<std::vector<int>> rank_tiles(nranks);
+  for(int itile = 0; itile < ntiles; itile++)
+    rank_tiles[TileMap::node(itile)].push_back(itile);
+
+  // A node with no tiles hands its share on to the next node with tiles,
+  // or after the last one to the last tile, so no particles are lost
   std::vector<int> tile_counts;
   tile_counts.resize(ntiles);
-  int node = 0;
-  int f = 0;
-  int chunk = rank_counts[0] / overdecompose;
-  for(int itile = 0; itile < tile_counts.size(); itile++) {
-    if((chunk <= rank_counts[node]) && (f != (overdecompose - 1))) {
-      tile_counts[itile] = chunk;
-      rank_counts[node] -= chunk;
-    } else {
-      tile_counts[itile] = rank_counts[node];
-      rank_counts[node] = 0;
+  int carried = 0;
+  for(int node = 0; node < nranks; node++) {
+    rank_counts[node] += carried;
+    carried = 0;
+
+    const int ntiles_here = rank_tiles[node].size();
+    if(ntiles_here == 0) {
+      carried = rank_counts[node];
+      continue;
     }
-    
-    f++;
-    if(f == overdecompose) {
-      node++;
-      chunk = rank_counts[node] / overdecompose;
-      f = 0;
+
+    int chunk = rank_counts[node] / ntiles_here;
+    for(int f = 0; f < ntiles_here; f++) {
+      const int itile = rank_tiles[node][f];
+      if((chunk <= rank_counts[node]) && (f != (ntiles_here - 1))) {
+        tile_counts[itile] = chunk;
+        rank_counts[node] -= chunk;
+      } else {
+        tile_counts[itile] = rank_counts[node];
+        rank_counts[node] = 0;
+      }
     }
   }
 
+  if(carried > 0)
+    tile_counts[ntiles - 1] += carried;
+
   return tile_counts;
 }
 
 void executeStep(int step, int num_steps, PMProxyType& proxy) {
-  auto me = vt::theContext()->getNode();
-
   // This will allow us to detect termination.
   auto epoch = vt::theTerm()->makeEpochCollective();
 
-  vt::theTerm()->addAction(epoch, [step, num_steps, &proxy, me]{
+  vt::theTerm()->addAction(epoch, [step, num_steps, &proxy]{
     total_time += (vt::timing::Timing::getCurrentTime() - start);
-    
-    if (step+1 < num_steps) {
-      initStep(step+1, num_steps, proxy);
-    } else {
-      if(me == 0) {
-        fmt::print("Total Time: {:.5f}\n", total_time);
 
-        // Gather up the particle counts to write out
-        // Also sum to ensure none have been lost
-        auto msg = vt::makeSharedMessage<ParticleMover::NullMsg>();
-        proxy.broadcast<ParticleMover::NullMsg, &ParticleMover::printParticleCountsHandler>(msg);
+    checkpointThen(step+1, proxy, [step, num_steps, &proxy]{
+      if (step+1 < num_steps) {
+        if(theLoadBalancer()->isDue(step+1))
+          balanceStep(step+1, num_steps, proxy);
+        else
+          initStep(step+1, num_steps, proxy);
+      } else {
+        finishRun(proxy);
       }
-    }
+    });
   });
 
   start = vt::timing::Timing::getCurrentTime();
   // Start the work
-  // TODO Try an implementation where each node starts its own
-  // tasks and see if that performs better
+  startTiles<ParticleMover::NullMsg, &ParticleMover::moveHandler>(epoch, proxy);
+
+  vt::theTerm()->finishedEpoch(epoch);
+}
+
+// Run the steps [step, last] in one epoch. Each tile sets its moves and
+// moves its particles in a single handler, then queues its next step, so
+// neighbouring tiles can be up to a window apart. The window stops short of
+// the next load balancing or checkpoint step
+void pipelineStep(int step, int num_steps, PMProxyType& proxy) {
+  auto me = vt::theContext()->getNode();
+
+  int last = step;
+  while(last+1 < num_steps && last - step < step_config.run_ahead && !theLoadBalancer()->isDue(last+1)
+    && !checkpointDue(last+1))
+    last++;
+
+  auto epoch = vt::theTerm()->makeEpochCollective();
+
+  vt::theTerm()->addAction(epoch, [last, num_steps, &proxy]{
+    total_time += (vt::timing::Timing::getCurrentTime() - start);
+
+    checkpointThen(last+1, proxy, [last, num_steps, &proxy]{
+      if (last+1 < num_steps) {
+        if(theLoadBalancer()->isDue(last+1))
+          balanceStep(last+1, num_steps, proxy);
+        else
+          pipelineStep(last+1, num_steps, proxy);
+      } else {
+        finishRun(proxy);
+      }
+    });
+  });
+
+  if(me == 0) {
+    if(last == step)
+      fmt::print("Starting step {}\n", step);
+    else
+      fmt::print("Starting steps {}-{}\n", step, last);
+  }
+
+  start = vt::timing::Timing::getCurrentTime();
+  startTiles<ParticleMover::StepMsg, &ParticleMover::stepHandler>(epoch, proxy, last - step + 1);
+
+  vt::theTerm()->finishedEpoch(epoch);
+}
+
+// First epoch of a step under the configured driver
+void startStep(int step, int num_steps, PMProxyType& proxy) {
+  if(step_config.driver == StepDriver::Pipelined)
+    pipelineStep(step, num_steps, proxy);
+  else
+    initStep(step, num_steps, proxy);
+}
+
+// Redistribute tiles over the nodes, then carry on with the step
+void balanceStep(int step, int num_steps, PMProxyType& proxy) {
+  auto me = vt::theContext()->getNode();
+
+  auto epoch = vt::theTerm()->makeEpochCollective();
+
+  vt::theTerm()->addAction(epoch, [step, num_steps, &proxy, me]{
+    if(me == 0)
+      fmt::print("Load balanced before step {}\n", step);
+
+    startStep(step, num_steps, proxy);
+  });
+
+  // Tiles send their loads to the root, which sends the new placement to
+  // every node, which migrates its tiles; all inside this epoch
   if(me == 0) {
     auto msg = vt::makeSharedMessage<ParticleMover::NullMsg>();
     vt::envelopeSetEpoch(msg->env, epoch);
-    proxy.broadcast<ParticleMover::NullMsg, &ParticleMover::moveHandler>(msg);
+    proxy.broadcast<ParticleMover::NullMsg, &ParticleMover::collectLoadHandler>(msg);
   }
 
   vt::theTerm()->finishedEpoch(epoch);
@@ -130,19 +295,107 @@ void initStep(int step, int num_steps, PMProxyType& proxy) {
     executeStep(step, num_steps, proxy);
   });
 
+  startTiles<ParticleMover::NullMsg, &ParticleMover::setNumMovesHandler>(epoch, proxy);
 
-  if(me == 0) {
-    auto msg = vt::makeSharedMessage<ParticleMover::NullMsg>();
-    vt::envelopeSetEpoch(msg->env, epoch);
-    proxy.broadcast<ParticleMover::NullMsg, &ParticleMover::setNumMovesHandler>(msg);
+  vt::theTerm()->finishedEpoch(epoch);
+}
+
+// Report the totals once the last step has finished
+void finishRun(PMProxyType& proxy) {
+  if(vt::theContext()->getNode() != 0)
+    return;
+
+  fmt::print("Total Time: {:.5f}\n", total_time);
+
+  // Gather up the particle counts to write out
+  // Also sum to ensure none have been lost
+  auto msg = vt::makeSharedMessage<ParticleMover::NullMsg>();
+  proxy.broadcast<ParticleMover::NullMsg, &ParticleMover::printParticleCountsHandler>(msg);
+
+  auto lmsg = vt::makeSharedMessage<ParticleMover::NullMsg>();
+  proxy.broadcast<ParticleMover::NullMsg, &ParticleMover::printMigrationLocalityHandler>(lmsg);
+
+  if(report_buffer_growth) {
+    auto amsg = vt::makeSharedMessage<ParticleMover::NullMsg>();
+    proxy.broadcast<ParticleMover::NullMsg, &ParticleMover::printBufferGrowthHandler>(amsg);
   }
 
-  vt::theTerm()->finishedEpoch(epoch);
+  if(theStorageConfig().report) {
+    auto smsg = vt::makeSharedMessage<ParticleMover::NullMsg>();
+    proxy.broadcast<ParticleMover::NullMsg, &ParticleMover::printStorageStatsHandler>(smsg);
+  }
+
+  if(theTelemetryConfig().enabled) {
+    auto tmsg = vt::makeSharedMessage<ParticleMover::NullMsg>();
+    proxy.broadcast<ParticleMover::NullMsg, &ParticleMover::reportTelemetryHandler>(tmsg);
+  }
 }
 
+// Fixed width lines, so the line of tile i is at a known offset and every
+// node writes the lines of its own tiles without any gathering. Opening
+// the file is a blocking MPI collective, so every node calls this from
+// main once the scheduler loop is over, never from an epoch action
+void writeTileDump(PMProxyType& proxy) {
+  auto me = vt::theContext()->getNode();
+
+  const std::string header = fmt::format("{:>10} {:>12} {:>16} {:>16} {:>16} {:>10} {:>10}\n",
+    "tile", "particles", "work_seconds", "storage_bytes", "peak_bytes", "grows", "shrinks");
+  const int line_bytes = header.size();
+
+  MPI_File fh;
+  MPI_File_open(MPI_COMM_WORLD, tile_dump_file.c_str(), MPI_MODE_CREATE | MPI_MODE_WRONLY, MPI_INFO_NULL, &fh);
+  MPI_File_set_size(fh, 0);
+
+  if(me == 0)
+    MPI_File_write_at(fh, 0, header.data(), line_bytes, MPI_CHAR, MPI_STATUS_IGNORE);
+
+  for(auto& tile : TileMap::localTiles(me)) {
+    // Tiles are at rest once the run is over, so TileMap is exact
+    auto local = proxy[tile].tryGetLocalPtr();
+    vtAssert(local != nullptr, "Tile dump needs every tile on the node TileMap places it on");
+
+    const auto& storage = local->storageStats();
+    const std::string line = fmt::format("{:>10} {:>12} {:>16.6f} {:>16} {:>16} {:>10} {:>10}\n", tile, local->size(),
+      local->getTimeMoved(), storage.bytes, storage.peak_bytes, storage.grows, storage.shrinks);
+    assert(("Tile dump line overflowed its width", line.size() == line_bytes));
+
+    const MPI_Offset offset = static_cast<MPI_Offset>(tile + 1) * line_bytes;
+    MPI_File_write_at(fh, offset, line.data(), line_bytes, MPI_CHAR, MPI_STATUS_IGNORE);
+  }
+
+  MPI_File_close(&fh);
+
+  if(me == 0)
+    fmt::print("Wrote tile dump to {}\n", tile_dump_file);
+}
+
+// Particle size is a compile time parameter. If the deck asks for a size
+// this executable was not built for, replace the process with the
+// PartExchange_p<bytes> variant next to it, before MPI is started
+void execParticleVariant(int argc, char** argv) {
+  if(argc < 2)
+    return;
+
+  const int particle_bytes = InputDeck::peekParticleBytes(argv[1]);
+  if(particle_bytes == 0 || particle_bytes == sizeof(Particle))
+    return;
+
+  std::string self(argv[0]);
+  const auto slash = self.rfind('/');
+  const std::string dir = slash == std::string::npos ? "." : self.substr(0, slash);
+  const std::string variant = dir + "/PartExchange_p" + std::to_string(particle_bytes);
+
+  if(access(variant.c_str(), X_OK) == 0) {
+    execv(variant.c_str(), argv);
+    std::cerr << "Failed to start " << variant << std::endl;
+  }
+  // Otherwise load() reports the mismatch
+}
 
 int main(int argc, char** argv) {
 
+  execParticleVariant(argc, argv);
+
   vt::CollectiveOps::initialize(argc, argv);
 
   int rank = vt::theContext()->getNode();
@@ -163,53 +416,130 @@ int main(int argc, char** argv) {
     }
   }
 
-  // Using the same seed removes the need for a bcast as everyone will get the same distro
-  std::vector<int> tile_counts = distributeParticles(deck.nparticles, nranks, deck.overdecompose, deck.dist_stdev, deck.base_seed);
+  report_buffer_growth = deck.report_buffer_growth;
+  step_config = deck.step_config;
+  tile_dump_file = deck.tile_dump_file;
+  checkpoint_config = deck.checkpoint_config;
+  if(rank == 0 && step_config.start == StepStart::Local)
+    fmt::print("Tiles started locally on each node\n");
+  theStorageConfig() = deck.storage_config;
+  theTelemetryConfig() = deck.telemetry_config;
+
+  theWorkModel()->calibrate(deck.work_model);
+  if(rank == 0)
+    fmt::print("Work model: {}\n", theWorkModel()->describe());
+
+  theThreadPool()->initialize(deck.mover_config.move_threads);
+  theThreadPool()->run([](int) { theWorkModel()->prepareThread(); });
+  if(rank == 0 && deck.mover_config.move_threads > 1)
+    fmt::print("Move kernel threads: {}\n", deck.mover_config.move_threads);
+  if(rank == 0 && deck.mover_config.rng.mode == RNGMode::Counter)
+    fmt::print("Counter RNG kernels: {}\n", moveKernelISA());
+
+  const int ntiles = nranks * deck.overdecompose;
 
   // Generate a graph where tiles are nodes and neighbours
-  // are linked by edges
-  GraphGenerator neighbour_graph(nranks * deck.overdecompose, deck.ave_neighbours, deck.base_seed);
+  // are linked by edges. Every node also keeps the full tile placement
+  // table; grid topologies place bricks of the grid on each node
+  std::unique_ptr<NeighbourGraph> neighbour_graph;
+  if(deck.topology != Topology::Random) {
+    const bool three_d = (deck.topology == Topology::Mesh3D || deck.topology == Topology::Torus3D);
+    const bool periodic = (deck.topology == Topology::Torus2D || deck.topology == Topology::Torus3D);
+    const auto dims = StencilGraph::factorGrid(ntiles, three_d ? 3 : 2);
+
+    neighbour_graph = std::make_unique<StencilGraph>(dims, deck.stencil_points, periodic);
+    TileMap::initializeGrid(dims, nranks);
+  } else {
+    if(deck.graph_generation == GraphGeneration::Distributed) {
+      neighbour_graph = std::make_unique<DistributedGraphGenerator>(ntiles, deck.ave_neighbours, deck.base_seed);
+    } else {
+      neighbour_graph = std::make_unique<GraphGenerator>(ntiles, deck.ave_neighbours, deck.base_seed);
+    }
+    TileMap::initialize(ntiles, nranks);
+  }
+
+  // Particles, engines and the step counter come from the checkpoint; the
+  // neighbour graph is regenerated from the deck as usual
+  CheckpointReader checkpoint;
+  const bool restart = !checkpoint_config.restart.empty();
+  if(restart) {
+    if(!checkpoint.open(checkpoint_config.restart, ntiles, TileMap::localTiles(rank))) {
+      vt::CollectiveOps::finalize();
+      return 1;
+    }
+    if(rank == 0)
+      fmt::print("Restarting from {} at step {}: {} particles from {} tiles over {} tiles\n",
+        checkpoint_config.restart, checkpoint.nextStep(), checkpoint.numParticles(), checkpoint.numTiles(), ntiles);
+  }
 
-  int my_start = 0;
-  /*const int my_nparticles = rank_counts[rank];
-  for(int i = 0; i < rank; i++)
-    my_start += rank_counts[i];*/
+  // Using the same seed removes the need for a bcast as everyone will get the same distro
+  std::vector<int> tile_counts = distributeParticles(deck.nparticles, nranks, deck.dist_stdev, deck.base_seed);
+
+  // Particle ids are numbered globally in tile order, so every particle has
+  // a unique id that keys its counter RNG draws
+  std::vector<int> tile_starts(tile_counts.size(), 0);
+  for(int i = 1; i < tile_counts.size(); i++)
+    tile_starts[i] = tile_starts[i - 1] + tile_counts[i - 1];
 
   using BaseIndexType = typename IndexType::DenseIndexType;
   auto const& range = IndexType(static_cast<BaseIndexType>(nranks*deck.overdecompose));
 
   int my_total = 0;
 
-  auto proxy = vt::theCollection()->constructCollective<ParticleMover>(
-    range, [&deck, rank, nranks, &tile_counts, my_start, &my_total, &neighbour_graph] (IndexType idx) {
+  auto proxy = vt::theCollection()->constructCollective<ParticleMover, TileMap::mapFn>(
+    range, [&deck, rank, nranks, &tile_counts, &tile_starts, &my_total, &neighbour_graph, &checkpoint, restart] (IndexType idx) {
       fmt::print("Tile {} lives on node {}\n", idx.x(), vt::theContext()->getNode());
       // Each tile needs a unique seed
       int tile_seed = deck.base_seed + idx.x();
-      my_total += tile_counts[idx.x()];
 
-      return std::make_unique<ParticleMover>(
-        tile_counts[idx.x()],
-        my_start,
+      auto mover = std::make_unique<ParticleMover>(
+        restart ? 0 : tile_counts[idx.x()],
+        restart ? 0 : tile_starts[idx.x()],
         deck.move_part_ns,
         deck.ave_crossings,
         deck.migration_chance,
         tile_seed,
         nranks*deck.overdecompose,
-        neighbour_graph.getNodeNeighbours(idx.x())
+        neighbour_graph->getNodeNeighbours(idx.x()),
+        deck.layout,
+        deck.mover_config
       );
+
+      if(restart)
+        checkpoint.restoreTile(idx.x(), nranks*deck.overdecompose, *mover);
+
+      my_total += mover->size();
+      return mover;
     }
   );
  
+  theNodeAggregator()->initialize(proxy, deck.mover_config.node_aggregation.max_bytes);
+  theLoadBalancer()->initialize(proxy, deck.lb_config);
+
   vt::theCollective()->barrierThen([&my_total]() {
       fmt::print("Node {} Initialised! Total: {}\n", vt::theContext()->getNode(), my_total);
   });
   
-  if(deck.nsteps > 0)
-    initStep(0, deck.nsteps, proxy);
+#ifdef PARTEXCHANGE_TRACE
+  // Start every node's trace clock together
+  MPI_Barrier(MPI_COMM_WORLD);
+#endif
+  traceInitialize();
+
+  const int first_step = restart ? checkpoint.nextStep() : 0;
+  if(first_step < deck.nsteps)
+    startStep(first_step, deck.nsteps, proxy);
+  else if(rank == 0)
+    fmt::print("Nothing to run: the run ends at step {}, the checkpoint is before step {}\n", deck.nsteps, first_step);
 
   while (!::vt::rt->isTerminated()) {
     vt::runScheduler();
   }
+
+  if(!tile_dump_file.empty())
+    writeTileDump(proxy);
+
+  traceFinalize(deck.trace_prefix, rank);
  
   vt::CollectiveOps::finalize();
 
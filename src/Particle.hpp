@@ -2,34 +2,98 @@
 #define PARTICLE_HPP
 #include <vt/transport.h>
 #include <vector>
+#include <cstdint>
+#include <type_traits>
+
+// Total particle size in bytes, fixed per executable. CMake builds a
+// PartExchange_p<bytes> variant for each size it is configured with
+#ifndef PARTEXCHANGE_PARTICLE_BYTES
+#define PARTEXCHANGE_PARTICLE_BYTES 96
+#endif
+
+template <int Bytes>
+struct ParticleT {
+  static_assert(Bytes >= 16 && Bytes % sizeof(int) == 0, "Particle size must be at least 16 bytes and a whole number of ints");
+
+  // Bytes left for the payload after the hot fields
+  static constexpr int payload_bytes = Bytes - 3 * sizeof(int);
 
-struct Particle {
   int id;
   int num_moves;
   int dead;
   
-  // Pad to 96 bytes so that sizes match
-  char dummy_data[84];
+  // Pad to Bytes so that sizes match
+  char dummy_data[payload_bytes];
 
-  Particle();
+  ParticleT();
 
-  Particle(const int id_);
-  Particle(const int id_, const int num_moves_);
+  ParticleT(const int id_);
+  ParticleT(const int id_, const int num_moves_);
 
-  Particle(const Particle& in);
+  // Copies are plain memberwise copies so that Particle stays trivially
+  // copyable and batches of particles can be moved around with memcpy
+  ParticleT(const ParticleT& in) = default;
 
-  Particle& operator=(const Particle & in);
+  ParticleT& operator=(const ParticleT & in) = default;
 
   template <typename SerializerT>
   void serialize(SerializerT& s) {
     s | id | num_moves | dead;
 
-    for(int i = 0; i < 84; i++) {
+    for(int i = 0; i < payload_bytes; i++) {
       s | dummy_data[i];
     }
   }
 };
 
+using Particle = ParticleT<PARTEXCHANGE_PARTICLE_BYTES>;
+
+static_assert(std::is_trivially_copyable<Particle>::value, "Particle must be trivially copyable for bulk serialization");
+static_assert(sizeof(Particle) == PARTEXCHANGE_PARTICLE_BYTES, "Particle must have no padding");
+
+// Sent in front of every serialized particle batch so the receiver can
+// check that the sender packed the particles the way it expects
+struct ParticleBatchHeader {
+  static constexpr uint32_t current_version = 1;
+
+  uint32_t version = current_version;
+  uint32_t bulk = 0;           // 1 if packed as a single contiguous block
+  uint32_t particle_bytes = sizeof(Particle);
+  uint32_t count = 0;
+
+  template <typename SerializerT>
+  void serialize(SerializerT& s) {
+    s | version | bulk | particle_bytes | count;
+  }
+};
+
+// Serialize a batch of particles. The fast path copies the whole batch as
+// one contiguous block; the fallback serializes each particle field by field
+template <typename SerializerT, typename AllocT>
+void serializeParticleBatch(SerializerT& s, std::vector<Particle, AllocT>& parts) {
+  ParticleBatchHeader header;
+  header.count = parts.size();
+#ifdef PARTEXCHANGE_BULK_SERIALIZE
+  header.bulk = 1;
+#endif
+
+  s | header;
+
+  if(s.isUnpacking()) {
+    vtAssert(header.version == ParticleBatchHeader::current_version, "Particle batch version mismatch");
+    vtAssert(header.particle_bytes == sizeof(Particle), "Particle batch layout mismatch");
+    parts.resize(header.count);
+  }
+
+  if(header.bulk) {
+    if(header.count > 0)
+      s.contiguousBytes(static_cast<void*>(parts.data()), sizeof(Particle), header.count);
+  } else {
+    for(auto& p : parts)
+      s | p;
+  }
+}
+
 /*struct ParticleMsg : vt::Message {
   ParticleMsg() = default;
 
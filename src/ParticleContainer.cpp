@@ -4,29 +4,109 @@
 #include <chrono>
 #include <thread>
 #include <algorithm>
+#include <cstring>
 
 ParticleContainer::ParticleContainer() : 
-  global_id(0) {}
+  layout(default_particle_layout), global_id(0) {}
 
-ParticleContainer::ParticleContainer(const int global_id_start_) :
-  global_id(global_id_start_) {}
+ParticleContainer::ParticleContainer(const int global_id_start_, const ParticleLayout layout_) :
+  layout(layout_), global_id(global_id_start_) {}
 
+Particle ParticleContainer::getParticle(const int idx) const {
+  if(layout == ParticleLayout::AoS)
+    return particles[idx];
+
+  Particle p(ids[idx], num_moves[idx]);
+  p.dead = deads[idx];
+  std::memcpy(p.dummy_data, &payload[static_cast<std::size_t>(idx) * payload_bytes], payload_bytes);
+  return p;
+}
+
+void ParticleContainer::setParticle(const int idx, const Particle& p) {
+  if(layout == ParticleLayout::AoS) {
+    particles[idx] = p;
+    return;
+  }
+
+  ids[idx] = p.id;
+  num_moves[idx] = p.num_moves;
+  deads[idx] = p.dead;
+  std::memcpy(&payload[static_cast<std::size_t>(idx) * payload_bytes], p.dummy_data, payload_bytes);
+}
+
+AoSParticleView ParticleContainer::aosView() {
+  assert(("AoS view requested from SoA container!", layout == ParticleLayout::AoS));
+  return AoSParticleView{particles.data()};
+}
+
+SoAParticleView ParticleContainer::soaView() {
+  assert(("SoA view requested from AoS container!", layout == ParticleLayout::SoA));
+  return SoAParticleView{ids.data(), num_moves.data(), deads.data()};
+}
 
 int ParticleContainer::addParticle() {
-  particles.push_back(Particle(global_id++));
-  int loc = particles.size() - 1;
-  return loc;
+  return addParticle(Particle(global_id++));
 }
 
 int ParticleContainer::addParticle(const Particle& p) {
-  particles.push_back(p);
-  int loc = particles.size() - 1;
+  // Route growth through the storage policy rather than the vector's own
+  if(size() == capacity())
+    reserveAdditional(1);
+
+  if(layout == ParticleLayout::AoS) {
+    particles.push_back(p);
+  } else {
+    ids.push_back(p.id);
+    num_moves.push_back(p.num_moves);
+    deads.push_back(p.dead);
+    payload.insert(payload.end(), p.dummy_data, p.dummy_data + payload_bytes);
+  }
+
+  int loc = size() - 1;
   return loc;
 }
 
+void ParticleContainer::copySlot(const int dst, const int src) {
+  if(layout == ParticleLayout::AoS) {
+    particles[dst] = particles[src];
+    return;
+  }
+
+  ids[dst] = ids[src];
+  num_moves[dst] = num_moves[src];
+  deads[dst] = deads[src];
+  std::memcpy(&payload[static_cast<std::size_t>(dst) * payload_bytes],
+    &payload[static_cast<std::size_t>(src) * payload_bytes], payload_bytes);
+}
+
+void ParticleContainer::moveSlots(const int dst, const int src, const int count) {
+  if(layout == ParticleLayout::AoS) {
+    std::memmove(&particles[dst], &particles[src], static_cast<std::size_t>(count) * sizeof(Particle));
+    return;
+  }
+
+  std::memmove(&ids[dst], &ids[src], count * sizeof(int));
+  std::memmove(&num_moves[dst], &num_moves[src], count * sizeof(int));
+  std::memmove(&deads[dst], &deads[src], count * sizeof(int));
+  std::memmove(&payload[static_cast<std::size_t>(dst) * payload_bytes],
+    &payload[static_cast<std::size_t>(src) * payload_bytes], static_cast<std::size_t>(count) * payload_bytes);
+}
+
+void ParticleContainer::resize(const int new_size) {
+  if(layout == ParticleLayout::AoS) {
+    particles.resize(new_size);
+    return;
+  }
+
+  ids.resize(new_size);
+  num_moves.resize(new_size);
+  deads.resize(new_size);
+  payload.resize(static_cast<std::size_t>(new_size) * payload_bytes);
+}
+
 void ParticleContainer::compactList(std::vector<int>& migrate_list) {
-  auto back = particles.size() - 1;
-  auto last_valid = particles.size() - migrate_list.size();
+  auto back = size() - 1;
+  auto last_valid = size() - migrate_list.size();
 
   for(int i = 0; i < migrate_list.size(); i++) {
     auto which_dead = migrate_list[i];
@@ -34,44 +114,179 @@ void ParticleContainer::compactList(std::vector<int>& migrate_list) {
     if(which_dead >= last_valid)
       continue;
     
-    while(back > which_dead && (particles[back].dead))
+    while(back > which_dead && dead(back))
       back--;
     
-    particles[which_dead] = particles[back];
+    copySlot(which_dead, back);
     back--;
   }
   
-  int new_size = particles.size() - migrate_list.size();
+  int new_size = size() - migrate_list.size();
   
-  particles.resize(new_size);
+  resize(new_size);
+  shrinkIfSparse();
   migrate_list.clear();
 }
 
+void ParticleContainer::extractMigrants(const std::vector<std::pair<int,int>>& dests, std::vector<std::vector<Particle>>& bufs, const bool stable) {
+  const int num_migrants = dests.size();
+  if(num_migrants == 0)
+    return;
+
+  const int old_size = size();
+
+  if(stable) {
+    int write = dests[0].first;
+    for(int i = 0; i < num_migrants; i++) {
+      const int which_dead = dests[i].first;
+      bufs[dests[i].second].push_back(getParticle(which_dead));
+
+      // Survivors up to the next migrant
+      const int run_end = i + 1 < num_migrants ? dests[i + 1].first : old_size;
+      const int run = run_end - which_dead - 1;
+      if(run > 0)
+        moveSlots(write, which_dead + 1, run);
+      write += run;
+    }
+  } else {
+    // Same hole filling as compactList. Only holes are overwritten, so a
+    // migrant is still intact when its turn to be packed comes
+    auto back = old_size - 1;
+    auto last_valid = old_size - num_migrants;
+
+    for(int i = 0; i < num_migrants; i++) {
+      const int which_dead = dests[i].first;
+      bufs[dests[i].second].push_back(getParticle(which_dead));
+
+      if(which_dead >= last_valid)
+        continue;
+
+      while(back > which_dead && dead(back))
+        back--;
+
+      copySlot(which_dead, back);
+      back--;
+    }
+  }
+
+  resize(old_size - num_migrants);
+  shrinkIfSparse();
+}
+
 void ParticleContainer::dumpParticles(const int rank) {
   
   std::cout << "****** Begin Rank " << rank << " Particle Dump ******" << std::endl;
-  for(auto &p : particles) {
-    std::cout << "ID: " << p.id << "\tNumMoves: " << p.num_moves << "\tDead: " << p.dead << std::endl;
+  for(int i = 0; i < size(); i++) {
+    std::cout << "ID: " << id(i) << "\tNumMoves: " << numMoves(i) << "\tDead: " << dead(i) << std::endl;
   }
   std::cout << "******* End Rank " << rank << " Particle Dump *******" << std::endl;
 }
 
+void ParticleContainer::writeParticles(std::ostream& out) const {
+  if(layout == ParticleLayout::AoS) {
+    out.write(reinterpret_cast<const char*>(particles.data()), static_cast<std::size_t>(size()) * sizeof(Particle));
+    return;
+  }
+
+  // Gather SoA particles a block at a time
+  constexpr int block = 1024;
+  std::vector<Particle> buf;
+  buf.reserve(block);
+
+  for(int start = 0; start < size(); start += block) {
+    const int end = std::min(start + block, size());
+    buf.clear();
+    for(int i = start; i < end; i++)
+      buf.push_back(getParticle(i));
+
+    out.write(reinterpret_cast<const char*>(buf.data()), buf.size() * sizeof(Particle));
+  }
+}
+
 int ParticleContainer::reserve(const int amount) {
-  particles.reserve(amount);
-  return particles.capacity();
+  const int old_capacity = capacity();
+
+  if(layout == ParticleLayout::AoS) {
+    particles.reserve(amount);
+  } else {
+    ids.reserve(amount);
+    num_moves.reserve(amount);
+    deads.reserve(amount);
+    payload.reserve(static_cast<std::size_t>(amount) * payload_bytes);
+  }
+
+  if(capacity() != old_capacity) {
+    stats.grows++;
+    updateStorageStats();
+  }
+  return capacity();
+}
+
+// Round a particle count up to whole storage chunks
+static long roundToChunks(const long count) {
+  const long chunk = std::max(theStorageConfig().chunk_particles, 1);
+  return ((count + chunk - 1) / chunk) * chunk;
 }
 
 int ParticleContainer::reserveAdditional(const int amount) {
-  if(particles.capacity() < (particles.size() + amount))
-    particles.reserve(particles.capacity() + amount);
+  const long needed = static_cast<long>(size()) + amount;
+  if(capacity() < needed) {
+    const long grown = static_cast<long>(capacity() * theStorageConfig().growth_factor);
+    reserve(roundToChunks(std::max(needed, grown)));
+  }
   
-  return particles.capacity();
+  return capacity();
+}
+
+int ParticleContainer::shrinkIfSparse() {
+  const auto& config = theStorageConfig();
+  const int chunk = std::max(config.chunk_particles, 1);
+
+  if(capacity() <= chunk || size() >= config.low_watermark * capacity())
+    return capacity();
+
+  const long target = roundToChunks(std::max(static_cast<long>(size() / config.high_watermark), static_cast<long>(chunk)));
+  if(target < capacity()) {
+    reallocate(target);
+    stats.shrinks++;
+    updateStorageStats();
+  }
+
+  return capacity();
+}
+
+// Copy a column into a fresh block of exactly new_capacity elements
+template <typename T>
+static void reallocateColumn(StorageVector<T>& column, const std::size_t new_capacity) {
+  StorageVector<T> fresh;
+  fresh.reserve(new_capacity);
+  fresh.assign(column.begin(), column.end());
+  column.swap(fresh);
+}
+
+void ParticleContainer::reallocate(const int new_capacity) {
+  if(layout == ParticleLayout::AoS) {
+    reallocateColumn(particles, new_capacity);
+    return;
+  }
+
+  reallocateColumn(ids, new_capacity);
+  reallocateColumn(num_moves, new_capacity);
+  reallocateColumn(deads, new_capacity);
+  reallocateColumn(payload, static_cast<std::size_t>(new_capacity) * payload_bytes);
+}
+
+void ParticleContainer::updateStorageStats() {
+  stats.bytes = particles.capacity() * sizeof(Particle)
+    + (ids.capacity() + num_moves.capacity() + deads.capacity()) * sizeof(int)
+    + payload.capacity();
+  stats.peak_bytes = std::max(stats.peak_bytes, stats.bytes);
 }
 
-int ParticleContainer::capacity() {
-  return particles.capacity();
+int ParticleContainer::capacity() const {
+  return layout == ParticleLayout::AoS ? particles.capacity() : ids.capacity();
 }
 
-int ParticleContainer::size() {
-  return particles.size();
+int ParticleContainer::size() const {
+  return layout == ParticleLayout::AoS ? particles.size() : ids.size();
 }
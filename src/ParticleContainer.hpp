@@ -1,31 +1,86 @@
 #ifndef PARTICLE_CONTAINER_HPP
 #define PARTICLE_CONTAINER_HPP
 #include "Particle.hpp"
+#include "ParticleStorage.hpp"
 #include <vt/transport.h>
 #include <vector>
 #include <random>
 #include <utility>
 #include <cassert>
 #include <cstdlib>
+#include <ostream>
 
 using IndexType = vt::IdxType1D<std::size_t>;
 
+// Memory layout of the particle storage.
+// AoS keeps whole Particle records together. SoA splits the hot fields
+// (id, num_moves, dead) into their own dense arrays and keeps the payload
+// in a separate cold array, so the move loop only streams the hot columns
+enum class ParticleLayout { AoS, SoA };
+
+// Default layout when the input deck does not choose one
+#ifdef PARTEXCHANGE_DEFAULT_LAYOUT_SOA
+constexpr ParticleLayout default_particle_layout = ParticleLayout::SoA;
+#else
+constexpr ParticleLayout default_particle_layout = ParticleLayout::AoS;
+#endif
+
+// Lightweight views over the hot fields, used by the move kernels so that
+// the layout is resolved once per kernel call rather than once per access.
+// Views are invalidated by anything that changes the container size
+struct AoSParticleView {
+  Particle* parts;
+
+  inline int& numMoves(const int idx) { return parts[idx].num_moves; }
+  inline int& dead(const int idx) { return parts[idx].dead; }
+  inline int id(const int idx) const { return parts[idx].id; }
+};
+
+struct SoAParticleView {
+  int* ids;
+  int* num_moves;
+  int* deads;
+
+  inline int& numMoves(const int idx) { return num_moves[idx]; }
+  inline int& dead(const int idx) { return deads[idx]; }
+  inline int id(const int idx) const { return ids[idx]; }
+};
+
 class ParticleContainer {
   public:
+    static constexpr int payload_bytes = sizeof(Particle::dummy_data);
+
     ParticleContainer();
-    ParticleContainer(const int global_id_start_);
+    ParticleContainer(const int global_id_start_, const ParticleLayout layout_ = default_particle_layout);
+
+    // Hot field accessors, valid for either layout
+    inline int& numMoves(const int idx) {
+      assert(("Particle container bounds error!", (idx < size()) && (idx >= 0)));
+      return layout == ParticleLayout::AoS ? particles[idx].num_moves : num_moves[idx];
+    }
 
-    // Access operators
-    inline Particle& operator[](const int idx) {
-      assert(("Particle container bounds error!", (idx < particles.size()) && (idx >= 0)));
-      return particles[idx];
+    inline int& dead(const int idx) {
+      assert(("Particle container bounds error!", (idx < size()) && (idx >= 0)));
+      return layout == ParticleLayout::AoS ? particles[idx].dead : deads[idx];
     }
 
-    inline const Particle& operator[](const int idx) const {
-      assert(("Particle container bounds error!", (idx < particles.size()) && (idx >= 0)));
-      return particles[idx];
+    inline int id(const int idx) const {
+      assert(("Particle container bounds error!", (idx < size()) && (idx >= 0)));
+      return layout == ParticleLayout::AoS ? particles[idx].id : ids[idx];
     }
 
+    // Gather a whole particle (hot fields and payload) into a Particle
+    Particle getParticle(const int idx) const;
+
+    // Scatter a whole particle into slot idx
+    void setParticle(const int idx, const Particle& p);
+
+    // Views over the hot fields for the move kernels
+    AoSParticleView aosView();
+    SoAParticleView soaView();
+
+    ParticleLayout getLayout() const { return layout; }
+
     // Adds a newly created particle with unique ID to the
     // end of the vector. Returns the index
     int addParticle();
@@ -38,27 +93,86 @@ class ParticleContainer {
     // that are migrated
     void compactList(std::vector<int> &migrate_list);
 
+    // Remove the particles in dests, (index, neighbour) pairs in ascending
+    // index order, appending each one to bufs[neighbour]. Packing and
+    // compaction share one pass over the migrants. Stable keeps the
+    // survivors in memory order by sliding the runs between migrants down;
+    // otherwise holes are filled from the back, one particle per migrant
+    void extractMigrants(const std::vector<std::pair<int,int>>& dests, std::vector<std::vector<Particle>>& bufs, const bool stable);
+
     // Dump state of all particles for debugging
     void dumpParticles(const int rank);
+
+    // Write every particle as a packed Particle record, in index order
+    void writeParticles(std::ostream& out) const;
     
     // Reserve a set amount of slots
     // Returns new capacity
     int reserve(const int amount);
 
     // Reserve an additional amount of slots if capacity < size + amount
-    // Capacity will be at least size + amount
+    // Capacity will be at least size + amount, grown geometrically and
+    // rounded up to whole chunks as set by theStorageConfig()
     // Returns new capacity
     int reserveAdditional(const int amount);
+
+    // Give memory back once occupancy drops below the low watermark
+    // Returns new capacity
+    int shrinkIfSparse();
+
+    // Capacity changes and bytes held so far
+    const StorageStats& storageStats() const { return stats; }
     
     // Get the number of particles we have
-    int size();
+    int size() const;
 
     // Get the current max capacity of the container
-    int capacity();
+    int capacity() const;
+
+    // Pack the whole container, so a tile can migrate between nodes
+    template <typename SerializerT>
+    void serialize(SerializerT& s) {
+      int layout_id = static_cast<int>(layout);
+      s | layout_id | global_id;
+      layout = static_cast<ParticleLayout>(layout_id);
+
+      serializeParticleBatch(s, particles);
+      serializeStorage(s, ids);
+      serializeStorage(s, num_moves);
+      serializeStorage(s, deads);
+      serializeStorage(s, payload);
+      s | stats;
+    }
 
   private:
-    std::vector<Particle> particles;
+    // Copy the particle in slot src over slot dst
+    void copySlot(const int dst, const int src);
+
+    // Slide count particles from slot src down to slot dst, dst < src
+    void moveSlots(const int dst, const int src, const int count);
+
+    // Truncate the container to new_size particles
+    void resize(const int new_size);
+
+    // Reallocate every column to exactly new_capacity slots
+    void reallocate(const int new_capacity);
+
+    // Refresh the byte counts after a capacity change
+    void updateStorageStats();
+
+    ParticleLayout layout;
+
+    // AoS storage
+    StorageVector<Particle> particles;
+
+    // SoA storage
+    StorageVector<int> ids;
+    StorageVector<int> num_moves;
+    StorageVector<int> deads;
+    StorageVector<char> payload;
+
     int global_id;
+    StorageStats stats;
 };
 
 #endif
@@ -1,14 +1,25 @@
 #include "ParticleContainer.hpp"
 #include "ParticleMover.hpp"
+#include "NodeAggregator.hpp"
+#include "TileMap.hpp"
+#include "LoadBalancer.hpp"
+#include "WorkModel.hpp"
+#include "ThreadPool.hpp"
+#include "MoveKernels.hpp"
+#include "Trace.hpp"
 #include <mpi.h>
 #include <iostream>
 #include <chrono>
 #include <thread>
 #include <algorithm>
 
-ParticleMover::ParticleMover(const int num_particles, const int start, const int move_part_ns_, const double ave_crossings, const int migrate_chance_, const int seed, const int ntiles_, const std::vector<int> neighbours_) :
-  particles(ParticleContainer(start)), particle_start_idx(0), move_part_ns(move_part_ns_), migrate_chance(migrate_chance_),
-  total_seconds(0.0), distribution(std::poisson_distribution<int>(ave_crossings)), ntiles(ntiles_), neighbours(neighbours_) {
+// Spare particle buffers kept per neighbour. Bounds the pool so a tile that
+// receives far more messages than it sends does not hoard memory
+static constexpr int max_pooled_buffers = 2;
+
+ParticleMover::ParticleMover(const int num_particles, const int start, const int move_part_ns_, const double ave_crossings, const int migrate_chance_, const int seed, const int ntiles_, const std::vector<int> neighbours_, const ParticleLayout layout_, const MoverConfig& config_) :
+  particles(ParticleContainer(start, layout_)), particle_start_idx(0), move_part_ns(move_part_ns_), migrate_chance(migrate_chance_),
+  total_seconds(0.0), mean_crossings(ave_crossings), distribution(std::poisson_distribution<int>(ave_crossings)), ntiles(ntiles_), neighbours(neighbours_), config(config_) {
 
   rank = vt::theContext()->getNode();
   nranks = vt::theContext()->getNumNodes();
@@ -28,115 +39,566 @@ ParticleMover::ParticleMover(const int num_particles, const int start, const int
   migrate_engine.seed(seed);
   neighbour_engine.seed(seed);
 
+  // Independent streams per kernel thread, derived from the seed and the
+  // thread id
+  if(config.move_threads > 1) {
+    for(int tid = 0; tid < config.move_threads; tid++) {
+      std::seed_seq migrate_seq{seed, tid, 0};
+      std::seed_seq neighbour_seq{seed, tid, 1};
+      thread_migrate_engines.emplace_back(migrate_seq);
+      thread_neighbour_engines.emplace_back(neighbour_seq);
+    }
+  }
+  thread_migrants.resize(config.move_threads);
+  thread_migrant_idx.resize(config.move_threads);
+  thread_migrant_neigh.resize(config.move_threads);
+  thread_ns.resize(config.move_threads);
+
   migrate_distribution = std::uniform_int_distribution<>(1, 100);
   neighbour_distribution = std::uniform_int_distribution<>(0, neighbours.size() - 1);
+  poisson_table = PoissonTable(ave_crossings);
+  log_stay = migrateLogStay(migrate_chance);
 
   for(int i = 0; i < num_particles; i++)
     particles.addParticle();
 
   particle_dests.reserve(100);
+  send_counts.resize(neighbours.size());
+  send_bufs.resize(neighbours.size());
+  buffer_pool.reserve(max_pooled_buffers * neighbours.size());
 }
 
 void ParticleMover::setNumMoves() {
+  TRACE_SCOPE("setNumMoves", (this->getIndex()).x());
+  endStepBufferGrowth();
+  step_open = true;
+
   particle_start_idx = 0;
-  for(int i = 0; i < particles.size(); i++) {
-    int num_crossings = distribution(engine);
-    particles[i].num_moves = num_crossings + 1;
+  step++;
+  kernel_step = step;
+
+  // Steps before this one are finished. Flush from a handler of our own,
+  // as this may be called directly when tiles are started locally
+  const auto& telemetry = theTelemetryConfig();
+  if(telemetry.enabled && telemetry.flush_interval > 0 && step - 1 - telemetry_first_step >= telemetry.flush_interval) {
+    auto fmsg = vt::makeSharedMessage<ParticleMover::TelemetryFlushMsg>(step - 1);
+    this->getCollectionProxy()[this->getIndex()].send<ParticleMover::TelemetryFlushMsg, &ParticleMover::flushTelemetryHandler>(fmsg);
   }
+
+  setNumMovesRange(0, particles.size());
 #if 0
   particles.dumpParticles(rank);
 #endif
 }
 
+void ParticleMover::setNumMovesRange(const int start, const int end) {
+  const double set_start = vt::timing::Timing::getCurrentTime();
+
+  if(config.rng.mode == RNGMode::Counter) {
+    if(end > start)
+      counterSetMoves(columns(), start, end, counterKey(), poisson_table);
+  } else {
+    for(int i = start; i < end; i++) {
+      int num_crossings = distribution(engine);
+      particles.numMoves(i) = num_crossings + 1;
+    }
+  }
+
+  record(TelemetryMetric::SetMovesSeconds, vt::timing::Timing::getCurrentTime() - set_start);
+}
+
+void ParticleMover::beginStep() {
+  // Everything handed to us so far belongs to earlier steps
+  catchUp();
+  if(pending_messages > 0)
+    flushIncoming();
+
+  setNumMoves();
+
+  // Early arrivals already carry their moves for this step
+  auto early = stashed_arrivals.find(step);
+  if(early != stashed_arrivals.end()) {
+    addIncoming(early->second.data(), early->second.size());
+    stashed_arrivals.erase(early);
+  }
+
+  moveParticles();
+}
+
 void ParticleMover::moveParticles() {
-  moveKernel(particle_start_idx, particles.size());
+  TRACE_SCOPE("moveParticles", (this->getIndex()).x());
+  const double load_start = vt::timing::Timing::getCurrentTime();
+  const int num_moved = particles.size() - particle_start_idx;
+
+  {
+    TRACE_SCOPE("moveKernel", (this->getIndex()).x());
+    moveKernel(particle_start_idx, particles.size());
+  }
+  const double move_end = vt::timing::Timing::getCurrentTime();
   
   // Migration starts here
   const int num_neighbours = neighbours.size();
-  std::vector<int> my_send_counts(neighbours.size());
-  std::vector<std::vector<Particle>> my_send_bufs(num_neighbours);
+  std::fill(send_counts.begin(), send_counts.end(), 0);
 
-  // Count how many we are sending, and pack them up
+  // Count how many we are sending
   for(int i = 0; i < particle_dests.size(); i++) {
     int neigh_idx = particle_dests[i].second;
 
-    my_send_counts[neigh_idx]++;
+    send_counts[neigh_idx]++;
   }
 
+  // Pack straight into the per-neighbour send buffers, which are moved
+  // into the outgoing messages, so each migrant is copied out of the
+  // container exactly once before serialization. The particle storage
+  // comes from the buffer pool, and the same pass over the migrants
+  // compacts the container
   for(int i = 0; i < num_neighbours; i++) {
-    my_send_bufs[i].reserve(my_send_counts[i]);
-  }
-  
-  for(int i = 0; i < particle_dests.size(); i++) {
-    int iPart = particle_dests[i].first;
-    int neigh_idx = particle_dests[i].second;
-    my_send_bufs[neigh_idx].push_back(particles[iPart]);
+    if(send_counts[i] > 0)
+      send_bufs[i] = takeSendBuffer(send_counts[i]);
   }
 
-  particles.compactList(migrate_list);
+  const int num_sent = particle_dests.size();
+  {
+    TRACE_SCOPE("extractMigrants", (this->getIndex()).x());
+    particles.extractMigrants(particle_dests, send_bufs, config.stable_compaction);
+  }
   particle_dests.clear();
   particle_start_idx = particles.size();
+  const double extract_end = vt::timing::Timing::getCurrentTime();
+  int num_messages = 0;
 
   const auto& proxy = this->getCollectionProxy();
 
   for(int i = 0; i < num_neighbours; i++) {
-    if(my_send_counts[i] > 0) {
-      auto msg = vt::makeSharedMessage<ParticleMover::ParticleMsg>();
-      msg->particles = my_send_bufs[i];
+    if(send_counts[i] > 0) {
+      num_messages++;
       const vt::NodeType to = neighbours[i];
+      TRACE_SEND("send", (this->getIndex()).x(), to, send_counts[i], send_counts[i] * sizeof(Particle));
+      if(TileMap::node(to) == rank)
+        sent_on_node += send_counts[i];
+      else
+        sent_off_node += send_counts[i];
 #if 0
-      fmt::print("Tile {} sending {} to {}. Epoch {}\n", (this->getIndex()).x(), my_send_counts[i], to, vt::theMsg()->getEpoch());
+      fmt::print("Tile {} sending {} to {}. Epoch {}\n", (this->getIndex()).x(), send_counts[i], to, vt::theMsg()->getEpoch());
 #endif
-      proxy[to].send<ParticleMover::ParticleMsg, &ParticleMover::particleMigrationHandler>(msg);
+      if(config.node_aggregation.enabled) {
+        theNodeAggregator()->send(to, std::move(send_bufs[i]), kernel_step);
+
+        // Remote batches are copied into the node buffer, so the storage
+        // is still ours to reuse
+        recycleBuffer(std::move(send_bufs[i]));
+      } else {
+        auto msg = vt::makeSharedMessage<ParticleMover::ParticleMsg>();
+        msg->particles = std::move(send_bufs[i]);
+        msg->step = kernel_step;
+        msg->from = (this->getIndex()).x();
+        proxy[to].send<ParticleMover::ParticleMsg, &ParticleMover::particleMigrationHandler>(msg);
+      }
     }
   }
+
+  const double send_end = vt::timing::Timing::getCurrentTime();
+  load_seconds += send_end - load_start;
+
+  // With node aggregation a message here is one segment of a node batch
+  record(TelemetryMetric::MoveSeconds, move_end - load_start);
+  record(TelemetryMetric::ExtractSeconds, extract_end - move_end);
+  record(TelemetryMetric::SendSeconds, send_end - extract_end);
+  record(TelemetryMetric::ParticlesMoved, num_moved);
+  record(TelemetryMetric::ParticlesSent, num_sent);
+  record(TelemetryMetric::MessagesSent, num_messages);
+  record(TelemetryMetric::BytesSent, static_cast<double>(num_sent) * sizeof(Particle));
+}
+
+static_assert(sizeof(Particle) % sizeof(int) == 0, "AoS columns need Particle to be a whole number of ints");
+
+ParticleColumns ParticleMover::columns() {
+  if(particles.getLayout() == ParticleLayout::SoA) {
+    const auto view = particles.soaView();
+    return {view.ids, view.num_moves, view.deads, 1};
+  }
+
+  const auto view = particles.aosView();
+  return {&view.parts->id, &view.parts->num_moves, &view.parts->dead, static_cast<int>(sizeof(Particle) / sizeof(int))};
+}
+
+CounterKey ParticleMover::counterKey() const {
+  return {static_cast<uint32_t>(config.rng.seed), static_cast<uint32_t>(kernel_step)};
 }
 
 void ParticleMover::moveKernel(const int start, const int end) {
+  // Resolve the layout once so the loop only touches the hot fields
+  if(config.rng.mode == RNGMode::Counter) {
+    moveKernelCounter(start, end);
+  } else if(config.move_threads > 1) {
+    if(particles.getLayout() == ParticleLayout::SoA)
+      moveKernelThreaded(particles.soaView(), start, end);
+    else
+      moveKernelThreaded(particles.aosView(), start, end);
+  } else {
+    if(particles.getLayout() == ParticleLayout::SoA)
+      moveKernelImpl(particles.soaView(), start, end);
+    else
+      moveKernelImpl(particles.aosView(), start, end);
+  }
+}
+
+template <typename ViewT>
+void ParticleMover::moveKernelImpl(ViewT view, const int start, const int end) {
   unsigned long total_ns = 0;
-  for(int iPart = start; iPart < end; iPart++) {
+
+  if(config.kernel == MoveKernelMode::ClosedForm) {
+    std::uniform_real_distribution<> unit_distribution(0., 1.);
+
+    for(int iPart = start; iPart < end; iPart++) {
+      // 1 - [0, 1) keeps the draw away from 0
+      const double u = 1. - unit_distribution(migrate_engine);
+      int moves_made;
+      const bool migrate = closedFormMove(view.numMoves(iPart), u, log_stay, moves_made);
+
+      view.numMoves(iPart) -= moves_made;
+      total_ns += static_cast<unsigned long>(moves_made) * move_part_ns;
+      if(migrate)
+        migrateParticle(iPart);
+    }
+  } else {
+    for(int iPart = start; iPart < end; iPart++) {
     
-    while(particles[iPart].num_moves > 0) {
-      particles[iPart].num_moves--;
-      total_ns += move_part_ns;
+      while(view.numMoves(iPart) > 0) {
+        view.numMoves(iPart)--;
+        total_ns += move_part_ns;
       
-      if(particles[iPart].num_moves > 0) { // If we only had one move, there was no crossing, so no migration either
-        const int migrate_roll = migrate_distribution(migrate_engine);
-        if(migrate_roll <= migrate_chance) {
-          migrateParticle(iPart);
-          break; // Move on as we're done with this one
+        if(view.numMoves(iPart) > 0) { // If we only had one move, there was no crossing, so no migration either
+          const int migrate_roll = migrate_distribution(migrate_engine);
+          if(migrate_roll <= migrate_chance) {
+            migrateParticle(iPart);
+            break; // Move on as we're done with this one
+          }
         }
       }
     }
   }
-  std::this_thread::sleep_for(std::chrono::nanoseconds(total_ns));
+  theWorkModel()->run(total_ns);
   
   double sec = total_ns / 1e9;
   total_seconds += sec;
 }
 
+template <typename ViewT>
+void ParticleMover::moveKernelThreaded(ViewT view, const int start, const int end) {
+  const int nthreads = config.move_threads;
+  assert(("Move Threads must match the thread pool size", theThreadPool()->size() == nthreads));
+
+  const int num_neighbours = neighbours.size();
+
+  theThreadPool()->run([&](const int tid) {
+    const long count = end - start;
+    const int chunk_start = start + count * tid / nthreads;
+    const int chunk_end = start + count * (tid + 1) / nthreads;
+
+    auto& my_migrate_engine = thread_migrate_engines[tid];
+    auto& my_neighbour_engine = thread_neighbour_engines[tid];
+    std::uniform_int_distribution<> my_migrate_distribution(1, 100);
+    std::uniform_int_distribution<> my_neighbour_distribution(0, num_neighbours - 1);
+
+    auto& migrants = thread_migrants[tid];
+    migrants.clear();
+
+    unsigned long my_ns = 0;
+
+    if(config.kernel == MoveKernelMode::ClosedForm) {
+      std::uniform_real_distribution<> unit_distribution(0., 1.);
+
+      for(int iPart = chunk_start; iPart < chunk_end; iPart++) {
+        const double u = 1. - unit_distribution(my_migrate_engine);
+        int moves_made;
+        const bool migrate = closedFormMove(view.numMoves(iPart), u, log_stay, moves_made);
+
+        view.numMoves(iPart) -= moves_made;
+        my_ns += static_cast<unsigned long>(moves_made) * move_part_ns;
+        if(migrate) {
+          view.dead(iPart) = 1;
+          migrants.emplace_back(iPart, my_neighbour_distribution(my_neighbour_engine));
+        }
+      }
+    } else {
+      for(int iPart = chunk_start; iPart < chunk_end; iPart++) {
+
+        while(view.numMoves(iPart) > 0) {
+          view.numMoves(iPart)--;
+          my_ns += move_part_ns;
+
+          if(view.numMoves(iPart) > 0) {
+            const int migrate_roll = my_migrate_distribution(my_migrate_engine);
+            if(migrate_roll <= migrate_chance) {
+              // Chunks are disjoint, so flagging the particle here is safe
+              view.dead(iPart) = 1;
+              migrants.emplace_back(iPart, my_neighbour_distribution(my_neighbour_engine));
+              break;
+            }
+          }
+        }
+      }
+    }
+    theWorkModel()->run(my_ns);
+
+    thread_ns[tid] = my_ns;
+  });
+
+  // Chunks are in index order, so the merged list is too
+  unsigned long total_ns = 0;
+  for(int tid = 0; tid < nthreads; tid++) {
+    particle_dests.insert(particle_dests.end(), thread_migrants[tid].begin(), thread_migrants[tid].end());
+    total_ns += thread_ns[tid];
+  }
+
+  double sec = total_ns / 1e9;
+  total_seconds += sec;
+}
+
+void ParticleMover::moveKernelCounter(const int start, const int end) {
+  if(end <= start)
+    return;
+
+  const int nthreads = config.move_threads;
+  assert(("Move Threads must match the thread pool size", theThreadPool()->size() == nthreads));
+
+  const ParticleColumns cols = columns();
+  const CounterKey key = counterKey();
+  const int num_neighbours = neighbours.size();
+
+  // Draws do not depend on order, so the chunks could be cut anywhere;
+  // they stay contiguous so the merged migrants are in index order
+  auto chunk = [&](const int tid) {
+    const long count = end - start;
+    const int chunk_start = start + count * tid / nthreads;
+    const int chunk_end = start + count * (tid + 1) / nthreads;
+
+    auto& idx = thread_migrant_idx[tid];
+    auto& neigh = thread_migrant_neigh[tid];
+    if(idx.size() < chunk_end - chunk_start + simd_slack) {
+      idx.resize(chunk_end - chunk_start + simd_slack);
+      neigh.resize(chunk_end - chunk_start + simd_slack);
+    }
+
+    int num_migrants = 0;
+    long moves;
+    if(config.kernel == MoveKernelMode::ClosedForm)
+      moves = counterMoveRangeClosedForm(cols, chunk_start, chunk_end, key, log_stay, num_neighbours,
+        idx.data(), neigh.data(), num_migrants);
+    else
+      moves = counterMoveRange(cols, chunk_start, chunk_end, key, migrate_chance, num_neighbours,
+        idx.data(), neigh.data(), num_migrants);
+
+    const unsigned long my_ns = moves * move_part_ns;
+    theWorkModel()->run(my_ns);
+
+    thread_ns[tid] = my_ns;
+    thread_migrants[tid].resize(num_migrants);
+    for(int m = 0; m < num_migrants; m++)
+      thread_migrants[tid][m] = std::make_pair(idx[m], neigh[m]);
+  };
+
+  if(nthreads > 1)
+    theThreadPool()->run(chunk);
+  else
+    chunk(0);
+
+  unsigned long total_ns = 0;
+  for(int tid = 0; tid < nthreads; tid++) {
+    particle_dests.insert(particle_dests.end(), thread_migrants[tid].begin(), thread_migrants[tid].end());
+    total_ns += thread_ns[tid];
+  }
+
+  double sec = total_ns / 1e9;
+  total_seconds += sec;
+}
+
 void ParticleMover::moveHandler(NullMsg *msg) {
 #if 0
   fmt::print("moveHandler invoked on {}\n", (this->getIndex()).x());
 #endif
+  TRACE_SCOPE("moveHandler", (this->getIndex()).x());
+  record(TelemetryMetric::HandlerCalls, 1);
   moveParticles();
 }
 
+void ParticleMover::stepHandler(StepMsg *msg) {
+  TRACE_SCOPE("stepHandler", (this->getIndex()).x());
+  beginStep();
+  record(TelemetryMetric::HandlerCalls, 1);
+
+  // Yield between steps so particles sent to us during this one are moved
+  // before we run ahead
+  if(msg->num_steps > 1) {
+    auto smsg = vt::makeSharedMessage<ParticleMover::StepMsg>(msg->num_steps - 1);
+    this->getCollectionProxy()[this->getIndex()].send<ParticleMover::StepMsg, &ParticleMover::stepHandler>(smsg);
+  }
+}
+
 void ParticleMover::particleMigrationHandler(ParticleMsg *msg) {
   int num_recv = msg->particles.size();
-  particles.reserveAdditional(num_recv);
+  record(TelemetryMetric::HandlerCalls, 1);
+  TRACE_SCOPE("particleMigrationHandler", (this->getIndex()).x());
+  TRACE_RECV("recv", (this->getIndex()).x(), msg->from, num_recv, num_recv * sizeof(Particle));
+
+  if(msg->step != step) {
+    stashIncoming(msg->particles.data(), num_recv, msg->step);
+    recycleBuffer(std::move(msg->particles));
+    catchUp();
+    return;
+  }
+
+  addIncoming(msg->particles.data(), num_recv);
+
+  // Keep the storage the message arrived in for our own sends
+  recycleBuffer(std::move(msg->particles));
+
+  if(!config.aggregation.enabled) {
+    moveParticles();
+    return;
+  }
+
+  queueIncoming(num_recv, true);
+}
+
+void ParticleMover::receiveLocal(std::vector<Particle>&& parts, const int from_step) {
+  int num_recv = parts.size();
+  receiveLocal(parts.data(), num_recv, from_step);
+  recycleBuffer(std::move(parts));
+}
+
+void ParticleMover::receiveLocal(const Particle* parts, const int count, const int from_step) {
+  TRACE_RECV("recv", (this->getIndex()).x(), -1, count, count * sizeof(Particle));
+
+  if(from_step != step) {
+    // Late particles are caught up by the flush handler
+    stashIncoming(parts, count, from_step);
+    if(from_step < step && !flush_scheduled)
+      scheduleFlush();
+    return;
+  }
+
+  addIncoming(parts, count);
+  queueIncoming(count, false);
+}
+
+void ParticleMover::stashIncoming(const Particle* parts, const int count, const int from_step) {
+  auto& stash = stashed_arrivals[from_step];
+  stash.insert(stash.end(), parts, parts + count);
+}
+
+bool ParticleMover::hasLateArrivals() const {
+  return !stashed_arrivals.empty() && stashed_arrivals.begin()->first < step;
+}
+
+void ParticleMover::catchUp() {
+  if(!hasLateArrivals())
+    return;
+
+  TRACE_SCOPE("catchUp", (this->getIndex()).x());
+
+  // Particles of the current step go first, so the range below only
+  // holds the late ones and their survivors
+  if(pending_messages > 0)
+    flushIncoming();
+
+  const int first = particles.size();
+  const int from_step = stashed_arrivals.begin()->first;
+
+  for(int s = from_step; s <= step; s++) {
+    kernel_step = s;
+    if(s > from_step)
+      setNumMovesRange(first, particles.size());
+
+    auto late = stashed_arrivals.find(s);
+    if(late != stashed_arrivals.end()) {
+      addIncoming(late->second.data(), late->second.size());
+      stashed_arrivals.erase(late);
+    }
+
+    particle_start_idx = first;
+    moveParticles();
+  }
+
+  kernel_step = step;
+}
+
+void ParticleMover::addIncoming(const Particle* parts, const int count) {
+  const int old_capacity = particles.capacity();
+  if(particles.reserveAdditional(count) != old_capacity)
+    step_buffer_growth++;
+
+  for(int i = 0; i < count; i++) {
+    const int idx = particles.addParticle(parts[i]);
+    particles.dead(idx) = 0;
+  }
+
+  record(TelemetryMetric::ParticlesReceived, count);
+}
+
+void ParticleMover::queueIncoming(const int num_recv, const bool allow_immediate) {
+  if(pending_messages == 0)
+    pending_since = vt::timing::Timing::getCurrentTime();
+
+  pending_messages++;
+  pending_particles += num_recv;
+
+  if(allow_immediate && config.aggregation.enabled && aggregationThresholdReached())
+    flushIncoming();
+  else if(!flush_scheduled)
+    scheduleFlush();
+}
+
+void ParticleMover::scheduleFlush() {
+  // Queue behind any messages already waiting for this tile
+  flush_scheduled = true;
+  auto fmsg = vt::makeSharedMessage<ParticleMover::NullMsg>();
+  this->getCollectionProxy()[this->getIndex()].send<ParticleMover::NullMsg, &ParticleMover::flushIncomingHandler>(fmsg);
+}
+
+void ParticleMover::flushIncomingHandler(NullMsg *msg) {
+  flush_scheduled = false;
+  record(TelemetryMetric::HandlerCalls, 1);
+  TRACE_SCOPE("flushIncomingHandler", (this->getIndex()).x());
+
+  catchUp();
 
-  for(int i = 0; i < num_recv; i++) {
-    auto p = msg->particles[i];
-    p.dead = 0;
-    particles.addParticle(p);
+  if(pending_messages == 0)
+    return;
+
+  // Without a time threshold, flush as soon as the queue has drained.
+  // Otherwise keep polling until a threshold is reached
+  if(config.aggregation.enabled && config.aggregation.max_wait_us > 0. && !aggregationThresholdReached()) {
+    scheduleFlush();
+    return;
   }
 
+  flushIncoming();
+}
+
+bool ParticleMover::aggregationThresholdReached() {
+  const auto& agg = config.aggregation;
+
+  if(agg.max_messages > 0 && pending_messages >= agg.max_messages)
+    return true;
+  if(agg.max_particles > 0 && pending_particles >= agg.max_particles)
+    return true;
+  if(agg.max_wait_us > 0. && (vt::timing::Timing::getCurrentTime() - pending_since) * 1e6 >= agg.max_wait_us)
+    return true;
+
+  return false;
+}
+
+void ParticleMover::flushIncoming() {
+  pending_messages = 0;
+  pending_particles = 0;
   moveParticles();
 }
 
 void ParticleMover::setNumMovesHandler(NullMsg *msg) {
   setNumMoves();  
+  record(TelemetryMetric::HandlerCalls, 1);
 }
 
 void ParticleMover::particleDumpHandler(DumpMsg *msg) {
@@ -147,21 +609,198 @@ void ParticleMover::printParticleCountsHandler(NullMsg *msg) {
   const auto& proxy = this->getCollectionProxy();
 
   int idx = (this->getIndex()).x();
-  auto rmsg = vt::makeSharedMessage<CustomPayloadMsg>(idx, particles.size());
-  proxy.reduce<vt::collective::PlusOp<CustomPayload>, PrintReduceResult>(rmsg);
+  auto rmsg = vt::makeSharedMessage<TileSummaryMsg>(idx, particles.size(), total_seconds);
+  proxy.reduce<vt::collective::PlusOp<TileSummary>, PrintReduceResult>(rmsg);
+}
+
+void ParticleMover::printStorageStatsHandler(NullMsg *msg) {
+  const auto& proxy = this->getCollectionProxy();
+
+  int idx = (this->getIndex()).x();
+  auto rmsg = vt::makeSharedMessage<StorageSummaryMsg>(idx, particles.storageStats());
+  proxy.reduce<vt::collective::PlusOp<StorageSummary>, PrintStorageResult>(rmsg);
+}
+
+void ParticleMover::reportTelemetryHandler(NullMsg *msg) {
+  flushTelemetry(step);
+}
+
+void ParticleMover::flushTelemetryHandler(TelemetryFlushMsg *msg) {
+  flushTelemetry(msg->end_step);
+}
+
+void ParticleMover::flushTelemetry(const int end_step) {
+  const int num_steps = end_step - telemetry_first_step;
+  if(num_steps <= 0)
+    return;
+
+  // Steps a tile recorded nothing in still take part
+  if(step_telemetry.size() < num_steps)
+    step_telemetry.resize(num_steps);
+
+  const std::vector<StepTelemetry> batch(step_telemetry.begin(), step_telemetry.begin() + num_steps);
+  step_telemetry.erase(step_telemetry.begin(), step_telemetry.begin() + num_steps);
+
+  const auto& proxy = this->getCollectionProxy();
+
+  auto rmsg = vt::makeSharedMessage<TelemetryMsg>(telemetry_first_step, batch);
+  proxy.reduce<vt::collective::PlusOp<TelemetryPayload>, WriteTelemetryResult>(rmsg);
+
+  telemetry_first_step = end_step;
+}
+
+void ParticleMover::printBufferGrowthHandler(NullMsg *msg) {
+  endStepBufferGrowth();
+
+  const auto& proxy = this->getCollectionProxy();
+
+  auto rmsg = vt::makeSharedMessage<BufferGrowthMsg>(buffer_growth_per_step);
+  proxy.reduce<vt::collective::PlusOp<BufferGrowthPayload>, PrintBufferGrowthResult>(rmsg);
+}
+
+void ParticleMover::printMigrationLocalityHandler(NullMsg *msg) {
+  const auto& proxy = this->getCollectionProxy();
+
+  auto rmsg = vt::makeSharedMessage<MigrationLocalityMsg>(sent_on_node, sent_off_node);
+  proxy.reduce<vt::collective::PlusOp<MigrationLocality>, PrintMigrationLocalityResult>(rmsg);
+}
+
+void ParticleMover::collectLoadHandler(NullMsg *msg) {
+  TRACE_SCOPE("collectLoadHandler", (this->getIndex()).x());
+  const auto& proxy = this->getCollectionProxy();
+
+  int idx = (this->getIndex()).x();
+  auto rmsg = vt::makeSharedMessage<TileLoadMsg>(idx, rank, load_seconds);
+  proxy.reduce<vt::collective::PlusOp<TileLoadPayload>, LoadBalanceResult>(rmsg);
+
+  resetLoad();
+}
+
+std::vector<Particle> ParticleMover::takeSendBuffer(const int count) {
+  std::vector<Particle> buf;
+
+  // Prefer the most recently recycled buffer, it is the most likely to be
+  // warm in cache
+  if(!buffer_pool.empty()) {
+    buf = std::move(buffer_pool.back());
+    buffer_pool.pop_back();
+  }
+
+  if(buf.capacity() < count) {
+    buf.reserve(count);
+    step_buffer_growth++;
+  }
+
+  return buf;
+}
+
+void ParticleMover::recycleBuffer(std::vector<Particle>&& buf) {
+  if(buf.capacity() == 0 || buffer_pool.size() >= max_pooled_buffers * neighbours.size())
+    return;
+
+  buf.clear();
+  buffer_pool.push_back(std::move(buf));
+}
+
+void ParticleMover::record(const TelemetryMetric metric, const double value) {
+  if(!theTelemetryConfig().enabled)
+    return;
+
+  // Work belongs to the step this tile started last, including particles
+  // caught up from earlier steps
+  const int idx = std::max(step, 1) - 1 - telemetry_first_step;
+  if(step_telemetry.size() <= idx)
+    step_telemetry.resize(idx + 1);
+
+  step_telemetry[idx][metric] += value;
+}
+
+void ParticleMover::endStepBufferGrowth() {
+  if(step_open)
+    buffer_growth_per_step.push_back(step_buffer_growth);
+
+  step_buffer_growth = 0;
+  step_open = false;
+}
+
+int ParticleMover::getStepBufferGrowth() {
+  return step_buffer_growth;
 }
 
 void ParticleMover::migrateParticle(const int idx) {
   const int neighbour_idx = neighbour_distribution(neighbour_engine); // Send to a rand neighbour
-  particles[idx].dead = 1;
-  migrate_list.push_back(idx);
+  migrateParticle(idx, neighbour_idx);
+}
+
+void ParticleMover::migrateParticle(const int idx, const int neighbour_idx) {
+  particles.dead(idx) = 1;
   particle_dests.emplace_back(idx, neighbour_idx);
 }
 
+double ParticleMover::getLoad() {
+  return load_seconds;
+}
+
+void ParticleMover::resetLoad() {
+  load_seconds = 0.;
+}
+
 double ParticleMover::getTimeMoved() {
   return total_seconds;
 }
 
+TileState ParticleMover::saveState() {
+  assert(("Tiles are checkpointed between steps", stashed_arrivals.empty() && pending_messages == 0));
+
+  TileState state;
+  state.tile = (this->getIndex()).x();
+  state.total_seconds = total_seconds;
+
+  std::ostringstream out;
+  out << engine << ' ' << migrate_engine << ' ' << neighbour_engine;
+  out << ' ' << thread_migrate_engines.size();
+  for(int tid = 0; tid < thread_migrate_engines.size(); tid++)
+    out << ' ' << thread_migrate_engines[tid] << ' ' << thread_neighbour_engines[tid];
+  state.engines = out.str();
+
+  return state;
+}
+
+void ParticleMover::writeParticles(std::ostream& out) const {
+  particles.writeParticles(out);
+}
+
+void ParticleMover::restoreState(const int next_step, const TileState& state) {
+  step = next_step;
+  kernel_step = next_step;
+  telemetry_first_step = next_step;
+  total_seconds = state.total_seconds;
+
+  if(state.engines.empty())
+    return;
+
+  std::istringstream in(state.engines);
+  in >> engine >> migrate_engine >> neighbour_engine;
+
+  // Per-thread streams only carry over to the same thread count
+  int nthreads = 0;
+  in >> nthreads;
+  if(nthreads == thread_migrate_engines.size()) {
+    for(int tid = 0; tid < nthreads; tid++)
+      in >> thread_migrate_engines[tid] >> thread_neighbour_engines[tid];
+  }
+}
+
+void ParticleMover::restoreParticles(const Particle* parts, const int count) {
+  particles.reserveAdditional(count);
+  for(int i = 0; i < count; i++)
+    particles.addParticle(parts[i]);
+}
+
 int ParticleMover::size() {
   return particles.size();
 }
+
+const StorageStats& ParticleMover::storageStats() const {
+  return particles.storageStats();
+}
@@ -3,6 +3,11 @@
 #include "Particle.hpp"
 #include "ParticleContainer.hpp"
 #include "CustomReducer.hpp"
+#include "MoverConfig.hpp"
+#include "CounterRNG.hpp"
+#include "MoveKernels.hpp"
+#include "Telemetry.hpp"
+#include "Checkpoint.hpp"
 
 #include <vt/transport.h>
 #include <vector>
@@ -10,11 +15,32 @@
 #include <utility>
 #include <cassert>
 #include <cstdlib>
+#include <string>
+#include <sstream>
+#include <map>
 
 using IndexType = vt::IdxType1D<std::size_t>;
 
 struct NullMsg : vt::Message {};
 
+// Pack a standard random engine through its textual state
+template <typename SerializerT, typename EngineT>
+void serializeEngine(SerializerT& s, EngineT& eng) {
+  std::string state;
+  if(!s.isUnpacking()) {
+    std::ostringstream out;
+    out << eng;
+    state = out.str();
+  }
+
+  s | state;
+
+  if(s.isUnpacking()) {
+    std::istringstream in(state);
+    in >> eng;
+  }
+}
+
 class ParticleMover : public vt::Collection<ParticleMover, IndexType> {
   public:
     
@@ -35,18 +61,42 @@ class ParticleMover : public vt::Collection<ParticleMover, IndexType> {
       // Add a serialiser that will serialise the particle vector
       template <typename SerializerT>
       void serialize(SerializerT& s) {
-        s | particles;
+        serializeParticleBatch(s, particles);
+        s | step | from;
       }
 
       public:
         std::vector<Particle> particles;
+        int step = 0;   // sender's step the particles were moved in
+        int from = -1;  // sending tile
+    };
+
+    // Run num_steps steps back to back, setting the moves of each step
+    // before moving its particles
+    struct StepMsg : vt::CollectionMessage<ParticleMover> {
+      StepMsg() = default;
+
+      StepMsg(int num_steps_) : num_steps(num_steps_) {}
+
+      public:
+        int num_steps;
+    };
+
+    struct TelemetryFlushMsg : vt::CollectionMessage<ParticleMover> {
+      TelemetryFlushMsg() = default;
+
+      TelemetryFlushMsg(int end_step_) : end_step(end_step_) {}
+
+      public:
+        int end_step;
     };
     
     ParticleMover() = default;
-    ParticleMover(const int num_particles, const int start, const int move_part_ns_, const double ave_crossings, const int migrate_chance_, const int seed, const int ntiles_, const std::vector<int> neighbours_);
+    ParticleMover(const int num_particles, const int start, const int move_part_ns_, const double ave_crossings, const int migrate_chance_, const int seed, const int ntiles_, const std::vector<int> neighbours_, const ParticleLayout layout_ = default_particle_layout, const MoverConfig& config_ = MoverConfig());
 
-    // Marks a particle for migration
+    // Marks a particle for migration, to a random or to the given neighbour
     void migrateParticle(const int idx);
+    void migrateParticle(const int idx, const int neighbour_idx);
     
     // Set particles an individual number of moves based on some distribution
     // Currently this is a poisson distribution to get the number of crossings
@@ -67,27 +117,193 @@ class ParticleMover : public vt::Collection<ParticleMover, IndexType> {
     // Query total time spent moving particles so far (sum of sleeps)
     double getTimeMoved();
 
+    // Times the migration buffers grew in the current step: send buffers
+    // the pool could not serve and particle container growth. vt message
+    // allocations and the receive side deserialisation are not counted
+    int getStepBufferGrowth();
+
     void moveHandler(NullMsg *msg);
 
+    // Pipelined step driver. Starts the next step, then queues the rest
+    // of the window behind the messages already waiting for this tile
+    void stepHandler(StepMsg *msg);
+
     // Handler to be called when we recv particles
     void particleMigrationHandler(ParticleMsg *msg);
 
+    // Particles handed over directly by a tile on the same node, moved by
+    // the sender during from_step. They are queued and moved from a later
+    // scheduler turn, never from inside the sender's own send loop
+    void receiveLocal(std::vector<Particle>&& parts, const int from_step);
+    void receiveLocal(const Particle* parts, const int count, const int from_step);
+
+    // Runs the move-and-send pass for coalesced incoming particles once the
+    // messages queued ahead of it have been handled
+    void flushIncomingHandler(NullMsg *msg);
+
     void setNumMovesHandler(NullMsg *msg);
 
     void particleDumpHandler(DumpMsg *msg);
 
     void printParticleCountsHandler(NullMsg *msg);
 
+    void printBufferGrowthHandler(NullMsg *msg);
+
+    void printMigrationLocalityHandler(NullMsg *msg);
+
+    void printStorageStatsHandler(NullMsg *msg);
+
+    // Reduce the per-step telemetry of every tile into the telemetry file,
+    // for the steps not written yet or those before end_step
+    void reportTelemetryHandler(NullMsg *msg);
+    void flushTelemetryHandler(TelemetryFlushMsg *msg);
+
+    // Contribute our measured load to a load balancing phase
+    void collectLoadHandler(NullMsg *msg);
+
     int size();
+
+    const StorageStats& storageStats() const;
+
+    // Checkpoint support. Tiles are saved and restored between steps, when
+    // no particles are in flight
+    TileState saveState();
+    void writeParticles(std::ostream& out) const;
+
+    // Continue from before step next_step. Engines are restored from state
+    // if it has any, otherwise the tile keeps the ones it was built with
+    void restoreState(const int next_step, const TileState& state);
+    void restoreParticles(const Particle* parts, const int count);
+
+    // Measured work since the last load balancing phase, and reset it
+    double getLoad();
+    void resetLoad();
+
+    // Full tile state, so vt can migrate the tile between nodes
+    template <typename SerializerT>
+    void serialize(SerializerT& s) {
+      vt::Collection<ParticleMover, IndexType>::serialize(s);
+
+      s | particles | particle_start_idx | move_part_ns | global_id;
+      s | migrate_chance | mean_crossings | total_seconds | ntiles | load_seconds;
+      s | neighbours | particle_dests | config;
+      s | step_buffer_growth | step_open | buffer_growth_per_step;
+      s | sent_on_node | sent_off_node;
+      s | pending_messages | pending_particles | flush_scheduled;
+      s | step | kernel_step | stashed_arrivals;
+      s | step_telemetry | telemetry_first_step;
+
+      serializeEngine(s, engine);
+      serializeEngine(s, migrate_engine);
+      serializeEngine(s, neighbour_engine);
+
+      thread_migrate_engines.resize(config.move_threads);
+      thread_neighbour_engines.resize(config.move_threads);
+      for(int tid = 0; tid < config.move_threads; tid++) {
+        serializeEngine(s, thread_migrate_engines[tid]);
+        serializeEngine(s, thread_neighbour_engines[tid]);
+      }
+
+      if(s.isUnpacking()) {
+        rank = vt::theContext()->getNode();
+        nranks = vt::theContext()->getNumNodes();
+
+        // Distributions only hold their parameters between draws
+        distribution = std::poisson_distribution<int>(mean_crossings);
+        migrate_distribution = std::uniform_int_distribution<>(1, 100);
+        neighbour_distribution = std::uniform_int_distribution<>(0, neighbours.size() - 1);
+        poisson_table = PoissonTable(mean_crossings);
+        log_stay = migrateLogStay(migrate_chance);
+
+        send_counts.resize(neighbours.size());
+        send_bufs.resize(neighbours.size());
+        thread_migrants.resize(config.move_threads);
+        thread_migrant_idx.resize(config.move_threads);
+        thread_migrant_neigh.resize(config.move_threads);
+        thread_ns.resize(config.move_threads);
+
+        // Time measured on the last node no longer applies
+        pending_since = vt::timing::Timing::getCurrentTime();
+      }
+    }
   
   private:
+    // Layout specific body of moveKernel
+    template <typename ViewT>
+    void moveKernelImpl(ViewT view, const int start, const int end);
+
+    // Same kernel with [start, end) split into one contiguous chunk per
+    // thread. Every thread draws from its own engines and records its own
+    // migrants, which are merged in chunk order, so the result only
+    // depends on the seed and the thread count
+    template <typename ViewT>
+    void moveKernelThreaded(ViewT view, const int start, const int end);
+
+    // Counter RNG kernel, split over the thread pool when Move Threads > 1
+    void moveKernelCounter(const int start, const int end);
+
+    // Hot fields of the current layout, and the key of this step's draws
+    ParticleColumns columns();
+    CounterKey counterKey() const;
+
+    // Draw the moves of particles [start, end) for kernel_step
+    void setNumMovesRange(const int start, const int end);
+
+    // setNumMoves followed by the move of every particle, including ones
+    // that arrived early for this step
+    void beginStep();
+
+    // Keep particles moved in a step other than ours until we get there
+    void stashIncoming(const Particle* parts, const int count, const int from_step);
+
+    // True if particles from a step we have already finished are stashed
+    bool hasLateArrivals() const;
+
+    // Move late particles through the rest of their step and every step
+    // since, so they end up where they would be had they been on time
+    void catchUp();
+
+    // Add value to a metric of the step this tile is in, if telemetry is on
+    void record(const TelemetryMetric metric, const double value);
+
+    // Contribute steps [telemetry_first_step, end_step) to a telemetry
+    // reduction and drop them. Every tile flushes the same steps
+    void flushTelemetry(const int end_step);
+
+    // Take a particle buffer from the pool with room for at least count
+    // particles. Only allocates when the pool has nothing big enough
+    std::vector<Particle> takeSendBuffer(const int count);
+
+    // Return a buffer's capacity to the pool once its particles are consumed
+    void recycleBuffer(std::vector<Particle>&& buf);
+
+    // Close off the buffer growth count of the step that just finished
+    void endStepBufferGrowth();
+
+    // Append received particles to the container
+    void addIncoming(const Particle* parts, const int count);
+
+    // Account for received particles and either move them now or queue a
+    // flush behind the messages already waiting for this tile
+    void queueIncoming(const int num_recv, const bool allow_immediate);
+
+    // Queue a flushIncomingHandler call to ourselves
+    void scheduleFlush();
+
+    // True once the coalesced incoming particles should be moved
+    bool aggregationThresholdReached();
+
+    // Move and send all coalesced incoming particles
+    void flushIncoming();
+
     ParticleContainer particles;
     int particle_start_idx;
-    std::vector<int> migrate_list;
     int move_part_ns;
     int global_id;
     int migrate_chance;
     double total_seconds;
+    double mean_crossings;
+    double load_seconds = 0.;
     int ntiles;
 
     std::mt19937 engine;
@@ -97,10 +313,60 @@ class ParticleMover : public vt::Collection<ParticleMover, IndexType> {
     std::uniform_int_distribution<> migrate_distribution;
     std::uniform_int_distribution<> neighbour_distribution;
 
+    // Steps started by this tile, and the step being moved, which keys the
+    // counter RNG draws and tags outgoing particles. The two only differ
+    // while late arrivals are caught up
+    int step = 0;
+    int kernel_step = 0;
+
+    // Particles that arrived tagged with another step, by that step. Only
+    // the pipelined driver lets neighbouring tiles be in different steps
+    std::map<int, std::vector<Particle>> stashed_arrivals;
+
+    // Measurements of the steps not written yet, from telemetry_first_step
+    std::vector<StepTelemetry> step_telemetry;
+    int telemetry_first_step = 0;
+    PoissonTable poisson_table;
+
+    // log(1 - p) of the migration chance, for the closed form kernel
+    double log_stay = 0.;
+
+    // Per-thread streams and results of the threaded and counter kernels.
+    // The index and neighbour arrays are the counter kernel's output
+    std::vector<std::mt19937> thread_migrate_engines;
+    std::vector<std::mt19937> thread_neighbour_engines;
+    std::vector<std::vector<std::pair<int,int>>> thread_migrants;
+    std::vector<std::vector<int>> thread_migrant_idx;
+    std::vector<std::vector<int>> thread_migrant_neigh;
+    std::vector<unsigned long> thread_ns;
+
     int rank;
     int nranks;
     std::vector<int> neighbours;
     std::vector<std::pair<int,int>> particle_dests;
+
+    // Migration buffers kept across moveParticles calls and steps so that
+    // steady-state migration does not grow them. Only the send side is
+    // pooled: vt allocates every ParticleMsg, its serialised bytes and the
+    // vector it is deserialised into, so migration still allocates per
+    // message. There is no message recycling arena
+    std::vector<int> send_counts;
+    std::vector<std::vector<Particle>> send_bufs;
+    std::vector<std::vector<Particle>> buffer_pool;
+    int step_buffer_growth = 0;
+    bool step_open = false;
+    std::vector<int> buffer_growth_per_step;
+
+    // Particles sent to tiles on this node and on other nodes
+    long sent_on_node = 0;
+    long sent_off_node = 0;
+
+    // Coalescing state for incoming migrations
+    MoverConfig config;
+    int pending_messages = 0;
+    int pending_particles = 0;
+    double pending_since = 0.;
+    bool flush_scheduled = false;
 };
 
 #endif
@@ -0,0 +1,60 @@
+#include "ParticleStorage.hpp"
+
+#include <cstdlib>
+#include <new>
+#include <sys/mman.h>
+#include <sys/syscall.h>
+#include <unistd.h>
+
+// Blocks below this come from the heap, whatever the config
+static constexpr std::size_t mmap_threshold = 2 << 20;
+
+// MPOL_PREFERRED from linux/mempolicy.h. With an empty node mask it
+// prefers the node of the allocating thread
+static constexpr int mpol_preferred = 1;
+
+StorageConfig& theStorageConfig() {
+  static StorageConfig config;
+  return config;
+}
+
+static bool useMapping(const std::size_t bytes) {
+  const auto& config = theStorageConfig();
+  return bytes >= mmap_threshold && (config.huge_pages || config.numa_local);
+}
+
+void* storageAllocate(const std::size_t bytes) {
+  if(!useMapping(bytes)) {
+    void* ptr = std::malloc(bytes);
+    if(ptr == nullptr && bytes > 0)
+      throw std::bad_alloc();
+    return ptr;
+  }
+
+  void* ptr = mmap(nullptr, bytes, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+  if(ptr == MAP_FAILED)
+    throw std::bad_alloc();
+
+  // Both are hints; the memory is usable if the kernel ignores them
+  const auto& config = theStorageConfig();
+#ifdef MADV_HUGEPAGE
+  if(config.huge_pages)
+    madvise(ptr, bytes, MADV_HUGEPAGE);
+#endif
+#ifdef SYS_mbind
+  if(config.numa_local)
+    syscall(SYS_mbind, ptr, bytes, mpol_preferred, nullptr, 0, 0);
+#endif
+
+  return ptr;
+}
+
+void storageDeallocate(void* ptr, const std::size_t bytes) {
+  if(ptr == nullptr)
+    return;
+
+  if(useMapping(bytes))
+    munmap(ptr, bytes);
+  else
+    std::free(ptr);
+}
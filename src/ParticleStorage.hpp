@@ -0,0 +1,98 @@
+#ifndef PARTICLE_STORAGE_HPP
+#define PARTICLE_STORAGE_HPP
+#include <vector>
+#include <cstddef>
+
+// Growth policy and backing memory of particle container storage. Each
+// column stays one contiguous array, so the move kernels and compaction
+// are unchanged; what changes is how capacity is sized and where the
+// pages come from
+struct StorageConfig {
+  // Capacity is always a whole number of chunks
+  int chunk_particles = 1024;
+
+  // Capacity grows to at least this multiple of the current capacity
+  double growth_factor = 1.5;
+
+  // Shrink once occupancy falls below low_watermark, to a capacity where
+  // occupancy is high_watermark
+  double low_watermark = 0.25;
+  double high_watermark = 0.75;
+
+  // Large blocks are mapped directly, with transparent huge pages and/or
+  // a preference for the NUMA node of the thread that allocates them
+  bool huge_pages = false;
+  bool numa_local = false;
+
+  // Print per-tile storage statistics at the end of the run
+  bool report = false;
+
+  template <typename SerializerT>
+  void serialize(SerializerT& s) {
+    s | chunk_particles | growth_factor | low_watermark | high_watermark;
+    s | huge_pages | numa_local | report;
+  }
+};
+
+// Process wide, set from the input deck before any tile is created
+StorageConfig& theStorageConfig();
+
+// Raw blocks for StorageAllocator. The heap or mmap choice only depends
+// on the size and the process wide config, so it is the same on release
+void* storageAllocate(const std::size_t bytes);
+void storageDeallocate(void* ptr, const std::size_t bytes);
+
+template <typename T>
+struct StorageAllocator {
+  using value_type = T;
+
+  StorageAllocator() = default;
+
+  template <typename U>
+  StorageAllocator(const StorageAllocator<U>&) {}
+
+  T* allocate(const std::size_t n) {
+    return static_cast<T*>(storageAllocate(n * sizeof(T)));
+  }
+
+  void deallocate(T* ptr, const std::size_t n) {
+    storageDeallocate(ptr, n * sizeof(T));
+  }
+};
+
+template <typename T, typename U>
+bool operator==(const StorageAllocator<T>&, const StorageAllocator<U>&) { return true; }
+
+template <typename T, typename U>
+bool operator!=(const StorageAllocator<T>&, const StorageAllocator<U>&) { return false; }
+
+template <typename T>
+using StorageVector = std::vector<T, StorageAllocator<T>>;
+
+// Capacity changes of one container and the bytes it holds
+struct StorageStats {
+  long grows = 0;
+  long shrinks = 0;
+  long bytes = 0;
+  long peak_bytes = 0;
+
+  template <typename SerializerT>
+  void serialize(SerializerT& s) {
+    s | grows | shrinks | bytes | peak_bytes;
+  }
+};
+
+// Pack a trivially copyable column in one copy
+template <typename SerializerT, typename T>
+void serializeStorage(SerializerT& s, StorageVector<T>& vec) {
+  std::size_t count = vec.size();
+  s | count;
+
+  if(s.isUnpacking())
+    vec.resize(count);
+
+  if(count > 0)
+    s.contiguousBytes(static_cast<void*>(vec.data()), sizeof(T), count);
+}
+
+#endif
@@ -0,0 +1,82 @@
+#include "StencilGraph.hpp"
+
+#include <algorithm>
+#include <cmath>
+#include <cstdlib>
+
+StencilGraph::StencilGraph(const std::vector<int>& dims_, const int stencil_points_, const bool periodic_) :
+  dims(dims_), stencil_points(stencil_points_), periodic(periodic_) {
+
+  // Pad to three dimensions so the neighbour walk is the same for both
+  while(dims.size() < 3)
+    dims.push_back(1);
+}
+
+std::vector<int> StencilGraph::factorGrid(const int num_nodes, const int ndims) {
+  std::vector<int> ret;
+  int remaining = num_nodes;
+
+  for(int d = ndims; d > 1; d--) {
+    // Largest divisor not above the d-th root of what is left
+    int target = static_cast<int>(std::floor(std::pow(remaining, 1.0 / d) + 1e-9));
+    int extent = std::max(target, 1);
+    while(remaining % extent != 0)
+      extent--;
+
+    ret.push_back(extent);
+    remaining /= extent;
+  }
+  ret.push_back(remaining);
+
+  // Longest extent along x keeps rows contiguous in index order
+  std::sort(ret.begin(), ret.end(), std::greater<int>());
+  return ret;
+}
+
+const std::vector<int> StencilGraph::getNodeNeighbours(const int node) {
+  const int nx = dims[0];
+  const int ny = dims[1];
+  const int nz = dims[2];
+
+  const int x = node % nx;
+  const int y = (node / nx) % ny;
+  const int z = node / (nx * ny);
+
+  std::vector<int> ret;
+
+  for(int dz = -1; dz <= 1; dz++) {
+    for(int dy = -1; dy <= 1; dy++) {
+      for(int dx = -1; dx <= 1; dx++) {
+        const int offsets = std::abs(dx) + std::abs(dy) + std::abs(dz);
+        if(offsets == 0)
+          continue;
+
+        // Face-only stencils (4 in 2D, 6 in 3D) skip edges and corners
+        const bool faces_only = (stencil_points == 4 || stencil_points == 6);
+        if(faces_only && offsets > 1)
+          continue;
+
+        int nxi = x + dx;
+        int nyi = y + dy;
+        int nzi = z + dz;
+
+        if(periodic) {
+          nxi = (nxi + nx) % nx;
+          nyi = (nyi + ny) % ny;
+          nzi = (nzi + nz) % nz;
+        } else if(nxi < 0 || nxi >= nx || nyi < 0 || nyi >= ny || nzi < 0 || nzi >= nz) {
+          continue;
+        }
+
+        ret.push_back(nxi + nx * (nyi + ny * nzi));
+      }
+    }
+  }
+
+  // Small periodic extents can wrap onto ourselves or the same neighbour
+  std::sort(ret.begin(), ret.end());
+  ret.erase(std::unique(ret.begin(), ret.end()), ret.end());
+  ret.erase(std::remove(ret.begin(), ret.end(), node), ret.end());
+
+  return ret;
+}
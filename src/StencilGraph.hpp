@@ -0,0 +1,32 @@
+#ifndef STENCIL_GRAPH_HPP
+#define STENCIL_GRAPH_HPP
+#include "NeighbourGraph.hpp"
+
+#include <vector>
+
+// Tiles laid out on a 2D or 3D Cartesian grid, x fastest, linked to their
+// stencil neighbours. 2D supports 4 (faces) or 8 (faces and corners)
+// points, 3D supports 6 (faces) or 26 (full box) points. With periodic
+// set the grid wraps around into a torus. Neighbour lists are computed on
+// demand from the tile index, so no graph is stored
+class StencilGraph : public NeighbourGraph {
+  public:
+    StencilGraph() = delete;
+
+    StencilGraph(const std::vector<int>& dims_, const int stencil_points_, const bool periodic_);
+
+    const std::vector<int> getNodeNeighbours(const int node) override;
+
+    const std::vector<int>& getDims() const { return dims; }
+
+    // Split num_nodes into ndims extents that are as close to equal as
+    // possible and multiply back to num_nodes exactly
+    static std::vector<int> factorGrid(const int num_nodes, const int ndims);
+
+  private:
+    std::vector<int> dims;
+    int stencil_points;
+    bool periodic;
+};
+
+#endif
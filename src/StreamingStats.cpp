@@ -0,0 +1,136 @@
+#include "StreamingStats.hpp"
+
+#include <algorithm>
+#include <cmath>
+
+constexpr double QuantileSketch::relative_accuracy;
+constexpr double QuantileSketch::min_value;
+constexpr int QuantileSketch::max_buckets;
+
+double QuantileSketch::gamma() {
+  return (1. + relative_accuracy) / (1. - relative_accuracy);
+}
+
+void QuantileSketch::push(const double x) {
+  if(x <= min_value) {
+    zero_count++;
+    return;
+  }
+
+  const int key = static_cast<int>(std::ceil(std::log(x) / std::log(gamma())));
+  auto it = std::lower_bound(buckets.begin(), buckets.end(), std::make_pair(key, 0L));
+  if(it != buckets.end() && it->first == key)
+    it->second++;
+  else
+    buckets.insert(it, std::make_pair(key, 1L));
+
+  bucket_count++;
+  collapse();
+}
+
+void QuantileSketch::merge(const QuantileSketch& other) {
+  std::vector<std::pair<int, long>> merged;
+  merged.reserve(buckets.size() + other.buckets.size());
+
+  auto a = buckets.begin();
+  auto b = other.buckets.begin();
+  while(a != buckets.end() || b != other.buckets.end()) {
+    if(b == other.buckets.end() || (a != buckets.end() && a->first < b->first)) {
+      merged.push_back(*a++);
+    } else if(a == buckets.end() || b->first < a->first) {
+      merged.push_back(*b++);
+    } else {
+      merged.emplace_back(a->first, a->second + b->second);
+      a++;
+      b++;
+    }
+  }
+
+  buckets.swap(merged);
+  zero_count += other.zero_count;
+  bucket_count += other.bucket_count;
+  collapse();
+}
+
+void QuantileSketch::collapse() {
+  if(buckets.size() <= max_buckets)
+    return;
+
+  // Fold the lowest buckets into the lowest one that is kept
+  const int excess = buckets.size() - max_buckets;
+  long folded = 0;
+  for(int i = 0; i < excess; i++)
+    folded += buckets[i].second;
+
+  buckets.erase(buckets.begin(), buckets.begin() + excess);
+  buckets.front().second += folded;
+}
+
+double QuantileSketch::quantile(const double q) const {
+  const long total = count();
+  if(total == 0)
+    return 0.;
+
+  // Rank of the sample at q, counted from 0
+  const long rank = static_cast<long>(std::min(std::max(q, 0.), 1.) * (total - 1));
+  if(rank < zero_count)
+    return 0.;
+
+  long seen = zero_count;
+  for(auto& bucket : buckets) {
+    seen += bucket.second;
+    if(seen > rank) {
+      // Midpoint of the bucket in relative terms
+      const double g = gamma();
+      return 2. * std::pow(g, bucket.first) / (g + 1.);
+    }
+  }
+
+  const double g = gamma();
+  return 2. * std::pow(g, buckets.back().first) / (g + 1.);
+}
+
+void StreamingStats::push(const double x) {
+  if(n == 0) {
+    lo = x;
+    hi = x;
+  } else {
+    lo = std::min(lo, x);
+    hi = std::max(hi, x);
+  }
+
+  n++;
+  const double delta = x - average;
+  average += delta / n;
+  m2 += delta * (x - average);
+
+  if(quantiles)
+    sketch.push(x);
+}
+
+void StreamingStats::merge(const StreamingStats& other) {
+  if(other.n == 0)
+    return;
+
+  if(n == 0) {
+    *this = other;
+    return;
+  }
+
+  // Chan et al. update of the mean and sum of squared deviations
+  const long total = n + other.n;
+  const double delta = other.average - average;
+  average += delta * other.n / total;
+  m2 += other.m2 + delta * delta * (static_cast<double>(n) * other.n / total);
+  n = total;
+
+  lo = std::min(lo, other.lo);
+  hi = std::max(hi, other.hi);
+
+  if(quantiles && other.quantiles)
+    sketch.merge(other.sketch);
+}
+
+double StreamingStats::stdev() const {
+  return std::sqrt(variance());
+}
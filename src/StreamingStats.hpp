@@ -0,0 +1,78 @@
+#ifndef STREAMING_STATS_HPP
+#define STREAMING_STATS_HPP
+#include <vector>
+#include <utility>
+
+// Mergeable quantile sketch over log-spaced buckets. A value x > 0 goes to
+// bucket ceil(log_gamma(x)), with gamma = (1 + a) / (1 - a) for relative
+// accuracy a, so any quantile is reported within a of a true sample.
+// Values at or below min_value share one zero bucket. Buckets are kept
+// sparse and sorted, and the lowest ones are folded together once there
+// are more than max_buckets, which only costs accuracy at the low end
+class QuantileSketch {
+  public:
+    static constexpr double relative_accuracy = 0.01;
+    static constexpr double min_value = 1e-9;
+    static constexpr int max_buckets = 2048;
+
+    void push(const double x);
+    void merge(const QuantileSketch& other);
+
+    // Value at quantile q in [0, 1], or 0 if the sketch is empty
+    double quantile(const double q) const;
+
+    long count() const { return zero_count + bucket_count; }
+
+    template <typename SerializerT>
+    void serialize(SerializerT& s) {
+      s | zero_count | bucket_count | buckets;
+    }
+
+  private:
+    static double gamma();
+    void collapse();
+
+    long zero_count = 0;
+    long bucket_count = 0;
+    std::vector<std::pair<int, long>> buckets;
+};
+
+// Single pass mean, variance, min and max (Welford), with an optional
+// quantile sketch. Samples are pushed as they are produced and partial
+// results from tiles and ranks are merged, so no samples are kept
+class StreamingStats {
+  public:
+    StreamingStats() = default;
+    StreamingStats(const bool quantiles_) : quantiles(quantiles_) {}
+
+    void push(const double x);
+    void merge(const StreamingStats& other);
+
+    long count() const { return n; }
+    double mean() const { return average; }
+    double variance() const { return n > 0 ? m2 / n : 0.; }
+    double stdev() const;
+    double min() const { return lo; }
+    double max() const { return hi; }
+
+    bool hasQuantiles() const { return quantiles; }
+    double quantile(const double q) const { return sketch.quantile(q); }
+
+    template <typename SerializerT>
+    void serialize(SerializerT& s) {
+      s | n | average | m2 | lo | hi | quantiles;
+      if(quantiles)
+        s | sketch;
+    }
+
+  private:
+    long n = 0;
+    double average = 0.;
+    double m2 = 0.;
+    double lo = 0.;
+    double hi = 0.;
+    bool quantiles = false;
+    QuantileSketch sketch;
+};
+
+#endif
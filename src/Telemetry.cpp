@@ -0,0 +1,49 @@
+#include "Telemetry.hpp"
+
+const char* telemetryMetricName(const TelemetryMetric metric) {
+  switch(metric) {
+    case TelemetryMetric::SetMovesSeconds: return "Set Moves Seconds";
+    case TelemetryMetric::MoveSeconds: return "Move Seconds";
+    case TelemetryMetric::ExtractSeconds: return "Pack And Compact Seconds";
+    case TelemetryMetric::SendSeconds: return "Send Seconds";
+    case TelemetryMetric::ParticlesMoved: return "Particles Moved";
+    case TelemetryMetric::ParticlesSent: return "Particles Sent";
+    case TelemetryMetric::ParticlesReceived: return "Particles Received";
+    case TelemetryMetric::MessagesSent: return "Messages Sent";
+    case TelemetryMetric::BytesSent: return "Bytes Sent";
+    case TelemetryMetric::HandlerCalls: return "Handler Calls";
+  }
+  return "Unknown";
+}
+
+TelemetryConfig& theTelemetryConfig() {
+  static TelemetryConfig config;
+  return config;
+}
+
+TelemetryPayload::TelemetryPayload(const int in_first_step, const std::vector<StepTelemetry>& steps) : first_step(in_first_step) {
+  const bool quantiles = theTelemetryConfig().quantiles;
+  stats.resize(steps.size() * num_telemetry_metrics, StreamingStats(quantiles));
+
+  for(int step = 0; step < steps.size(); step++) {
+    for(int m = 0; m < num_telemetry_metrics; m++)
+      stats[step * num_telemetry_metrics + m].push(steps[step].values[m]);
+  }
+}
+
+// Kept open for the whole run, so batches are appended
+static OutputWriter& telemetryWriter() {
+  const auto& config = theTelemetryConfig();
+  static OutputWriter writer(config.file, config.format);
+  return writer;
+}
+
+void WriteTelemetryResult::operator() (TelemetryMsg* msg) {
+  const auto& val = msg->getConstVal();
+
+  std::vector<std::string> names;
+  for(int m = 0; m < num_telemetry_metrics; m++)
+    names.push_back(telemetryMetricName(static_cast<TelemetryMetric>(m)));
+
+  telemetryWriter().writeSteps(val.first_step, names, val.stats);
+}
@@ -0,0 +1,100 @@
+#ifndef TELEMETRY_HPP
+#define TELEMETRY_HPP
+#include <vt/transport.h>
+#include "OutputWriter.hpp"
+#include "StreamingStats.hpp"
+#include <array>
+#include <vector>
+#include <string>
+
+// Quantities every tile measures in each step. The seconds are wall time
+// of a phase: drawing the moves, the move kernel, packing the migrants
+// and compacting the container (one fused pass), and handing the batches
+// to vt or the node aggregator
+enum class TelemetryMetric {
+  SetMovesSeconds, MoveSeconds, ExtractSeconds, SendSeconds,
+  ParticlesMoved, ParticlesSent, ParticlesReceived, MessagesSent, BytesSent,
+  HandlerCalls
+};
+
+constexpr int num_telemetry_metrics = static_cast<int>(TelemetryMetric::HandlerCalls) + 1;
+
+const char* telemetryMetricName(const TelemetryMetric metric);
+
+struct TelemetryConfig {
+  bool enabled = false;
+  std::string file = "telemetry.out.yaml";
+  OutputFormat format = OutputFormat::YAML;
+
+  // Steps per written batch, 0 writes everything at the end of the run
+  int flush_interval = 0;
+
+  // Add p50/p95/p99 over tiles from a quantile sketch
+  bool quantiles = false;
+};
+
+// Process wide, set from the input deck before any tile is created
+TelemetryConfig& theTelemetryConfig();
+
+// One tile's measurements in one step
+struct StepTelemetry {
+  double& operator[](const TelemetryMetric metric) {
+    return values[static_cast<int>(metric)];
+  }
+
+  template <typename SerializerT>
+  void serialize(SerializerT& s) {
+    s | values;
+  }
+
+  std::array<double, num_telemetry_metrics> values{};
+};
+
+// Stats of every metric of a batch of steps, step major. Merged
+// element-wise, so the size only depends on the number of steps
+struct TelemetryPayload {
+  TelemetryPayload() = default;
+  TelemetryPayload(const int in_first_step, const std::vector<StepTelemetry>& steps);
+
+  friend TelemetryPayload operator+(TelemetryPayload& in1, TelemetryPayload const& in2) {
+    if(in1.stats.size() < in2.stats.size())
+      in1.stats.resize(in2.stats.size());
+
+    for(int i = 0; i < in2.stats.size(); i++) {
+      in1.stats[i].merge(in2.stats[i]);
+    }
+
+    return in1;
+  }
+
+  template <typename SerializerT>
+  void serialize(SerializerT& s) {
+    s | first_step | stats;
+  }
+
+  int first_step = 0;
+  std::vector<StreamingStats> stats;
+};
+
+struct TelemetryMsg : vt::collective::ReduceTMsg<TelemetryPayload> {
+  TelemetryMsg() = default;
+
+  TelemetryMsg(const int in_first_step, const std::vector<StepTelemetry>& steps) : vt::collective::ReduceTMsg<TelemetryPayload>() {
+    getVal() = TelemetryPayload(in_first_step, steps);
+  }
+
+  template <typename SerializerT>
+  void serialize(SerializerT& s) {
+    ReduceTMsg<TelemetryPayload>::invokeSerialize(s);
+  }
+};
+
+// Appends a reduced batch to the configured file
+struct WriteTelemetryResult {
+  WriteTelemetryResult() = default;
+  ~WriteTelemetryResult() = default;
+
+  void operator() (TelemetryMsg* msg);
+};
+
+#endif
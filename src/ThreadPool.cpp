@@ -0,0 +1,74 @@
+#include "ThreadPool.hpp"
+#include "Trace.hpp"
+
+ThreadPool* theThreadPool() {
+  static ThreadPool pool;
+  return &pool;
+}
+
+ThreadPool::~ThreadPool() {
+  {
+    std::lock_guard<std::mutex> lock(mutex);
+    stopping = true;
+  }
+  start_cv.notify_all();
+
+  for(auto& worker : workers)
+    worker.join();
+}
+
+void ThreadPool::initialize(const int nthreads_) {
+  nthreads = nthreads_ > 1 ? nthreads_ : 1;
+
+  for(int tid = 1; tid < nthreads; tid++)
+    workers.emplace_back(&ThreadPool::workerLoop, this, tid);
+}
+
+void ThreadPool::run(const std::function<void(int)>& fn) {
+  if(nthreads == 1) {
+    fn(0);
+    return;
+  }
+
+  {
+    std::lock_guard<std::mutex> lock(mutex);
+    job = &fn;
+    remaining = nthreads - 1;
+    generation++;
+  }
+  start_cv.notify_all();
+
+  fn(0);
+
+  std::unique_lock<std::mutex> lock(mutex);
+  done_cv.wait(lock, [this]{ return remaining == 0; });
+  job = nullptr;
+}
+
+void ThreadPool::workerLoop(const int tid) {
+  long seen = 0;
+
+  while(true) {
+    const std::function<void(int)>* my_job;
+    {
+      std::unique_lock<std::mutex> lock(mutex);
+      start_cv.wait(lock, [this, seen]{ return stopping || generation != seen; });
+      if(stopping)
+        return;
+
+      seen = generation;
+      my_job = job;
+    }
+
+    {
+      TRACE_SCOPE("poolTask", -1);
+      (*my_job)(tid);
+    }
+
+    {
+      std::lock_guard<std::mutex> lock(mutex);
+      remaining--;
+    }
+    done_cv.notify_one();
+  }
+}
@@ -0,0 +1,44 @@
+#ifndef THREAD_POOL_HPP
+#define THREAD_POOL_HPP
+#include <vector>
+#include <thread>
+#include <mutex>
+#include <condition_variable>
+#include <functional>
+
+// Fixed set of worker threads for splitting compute kernels across the
+// cores of a node. Workers never touch vt; the calling (scheduler) thread
+// takes part as thread 0 and waits for the others before returning
+class ThreadPool {
+  public:
+    ThreadPool() = default;
+    ~ThreadPool();
+
+    ThreadPool(const ThreadPool&) = delete;
+    ThreadPool& operator=(const ThreadPool&) = delete;
+
+    // Start nthreads_ - 1 workers
+    void initialize(const int nthreads_);
+
+    int size() const { return nthreads; }
+
+    // Run fn(tid) for every tid in [0, size()) and wait for all of them
+    void run(const std::function<void(int)>& fn);
+
+  private:
+    void workerLoop(const int tid);
+
+    int nthreads = 1;
+    std::vector<std::thread> workers;
+    std::mutex mutex;
+    std::condition_variable start_cv;
+    std::condition_variable done_cv;
+    const std::function<void(int)>* job = nullptr;
+    long generation = 0;
+    int remaining = 0;
+    bool stopping = false;
+};
+
+ThreadPool* theThreadPool();
+
+#endif
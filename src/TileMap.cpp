@@ -0,0 +1,111 @@
+#include "TileMap.hpp"
+
+int TileMap::ntiles = 0;
+int TileMap::nnodes = 1;
+std::vector<vt::NodeType> TileMap::locations;
+std::vector<vt::NodeType> TileMap::home_locations;
+
+void TileMap::initialize(const int ntiles_, const int nnodes_) {
+  ntiles = ntiles_;
+  nnodes = nnodes_;
+
+  locations.resize(ntiles);
+  for(int tile = 0; tile < ntiles; tile++) {
+    locations[tile] = static_cast<vt::NodeType>((static_cast<long>(tile) * nnodes) / ntiles);
+  }
+
+  home_locations = locations;
+}
+
+void TileMap::initializeGrid(const std::vector<int>& dims, const int nnodes_) {
+  nnodes = nnodes_;
+  ntiles = 1;
+  for(auto& extent : dims)
+    ntiles *= extent;
+
+  // Split the nodes into a process grid, handing each prime factor to the
+  // dimension with the most tiles per node left, among those it divides
+  // evenly or, failing that, those it still leaves with at least one tile
+  // per node. That keeps the bricks close to cubes. If some factor fits
+  // no dimension, fall back to blocks in index order
+  std::vector<int> procs(dims.size(), 1);
+  int remaining = nnodes;
+  for(int factor = 2; remaining > 1; ) {
+    if(remaining % factor != 0) {
+      factor++;
+      continue;
+    }
+
+    int best = -1;
+    bool best_divides = false;
+    for(int d = 0; d < dims.size(); d++) {
+      if(static_cast<long>(procs[d]) * factor > dims[d])
+        continue;
+
+      const bool divides = dims[d] % (procs[d] * factor) == 0;
+      const bool more_tiles = best < 0
+        || static_cast<double>(dims[d]) / procs[d] > static_cast<double>(dims[best]) / procs[best];
+      if(best < 0 || (divides && !best_divides) || (divides == best_divides && more_tiles)) {
+        best = d;
+        best_divides = divides;
+      }
+    }
+
+    if(best < 0) {
+      initialize(ntiles, nnodes);
+      return;
+    }
+
+    procs[best] *= factor;
+    remaining /= factor;
+  }
+
+  locations.resize(ntiles);
+  for(int tile = 0; tile < ntiles; tile++) {
+    int rest = tile;
+    int node_id = 0;
+    int node_stride = 1;
+    for(int d = 0; d < dims.size(); d++) {
+      const int coord = rest % dims[d];
+      rest /= dims[d];
+
+      const int node_coord = static_cast<int>((static_cast<long>(coord) * procs[d]) / dims[d]);
+      node_id += node_coord * node_stride;
+      node_stride *= procs[d];
+    }
+
+    locations[tile] = static_cast<vt::NodeType>(node_id);
+  }
+
+  home_locations = locations;
+}
+
+vt::NodeType TileMap::node(const int tile) {
+  return locations[tile];
+}
+
+vt::NodeType TileMap::homeNode(const int tile) {
+  return home_locations[tile];
+}
+
+std::vector<int> TileMap::localTiles(const vt::NodeType on_node) {
+  std::vector<int> ret;
+  for(int tile = 0; tile < ntiles; tile++) {
+    if(locations[tile] == on_node)
+      ret.push_back(tile);
+  }
+
+  return ret;
+}
+
+void TileMap::setNode(const int tile, const vt::NodeType to_node) {
+  locations[tile] = to_node;
+}
+
+int TileMap::numTiles() {
+  return ntiles;
+}
+
+vt::NodeType TileMap::mapFn(IndexType* idx, IndexType* max, vt::NodeType nnodes) {
+  return homeNode(idx->x());
+}
@@ -0,0 +1,48 @@
+#ifndef TILE_MAP_HPP
+#define TILE_MAP_HPP
+#include <vt/transport.h>
+#include <vector>
+
+using IndexType = vt::IdxType1D<std::size_t>;
+
+// Placement of tiles on nodes. By default tiles are blocked over the nodes
+// in index order. For tiles on a Cartesian grid the nodes instead own
+// bricks of the grid, so that most stencil neighbours share a node.
+// Every node holds the same table so it can work out where to send
+// particles for any tile without asking. Load balancing updates where
+// tiles currently are, but a tile's home node, which vt routes through,
+// stays the initial placement for the whole run
+class TileMap {
+  public:
+    TileMap() = delete;
+
+    static void initialize(const int ntiles_, const int nnodes_);
+
+    // Brick placement for tiles on a grid of the given extents (x fastest)
+    static void initializeGrid(const std::vector<int>& dims, const int nnodes_);
+
+    // Node that tile currently lives on
+    static vt::NodeType node(const int tile);
+
+    // Node that tile was first placed on
+    static vt::NodeType homeNode(const int tile);
+
+    // Tiles that live on a given node
+    static std::vector<int> localTiles(const vt::NodeType on_node);
+
+    static int numTiles();
+
+    // Record that a tile has moved to another node. Its home is unchanged
+    static void setNode(const int tile, const vt::NodeType to_node);
+
+    // Collection map function handed to vt, giving each tile's home node
+    static vt::NodeType mapFn(IndexType* idx, IndexType* max, vt::NodeType nnodes);
+
+  private:
+    static int ntiles;
+    static int nnodes;
+    static std::vector<vt::NodeType> locations;
+    static std::vector<vt::NodeType> home_locations;
+};
+
+#endif
@@ -0,0 +1,127 @@
+#include "Trace.hpp"
+
+#include <vector>
+#include <memory>
+#include <mutex>
+#include <fstream>
+#include <algorithm>
+#include <iostream>
+#include <fmt/format.h>
+
+static_assert((PARTEXCHANGE_TRACE_EVENTS & (PARTEXCHANGE_TRACE_EVENTS - 1)) == 0, "PARTEXCHANGE_TRACE_EVENTS must be a power of two");
+
+namespace {
+
+using TraceClock = std::chrono::steady_clock;
+
+TraceClock::time_point trace_start = TraceClock::now();
+
+struct TraceBuffer {
+  TraceBuffer(const int tid_) : tid(tid_), events(PARTEXCHANGE_TRACE_EVENTS) {}
+
+  int tid;
+  uint64_t next = 0;
+  std::vector<TraceEvent> events;
+};
+
+// Every buffer ever created, in thread creation order. Only touched when a
+// thread records its first event and at finalize
+std::mutex buffers_mutex;
+std::vector<std::unique_ptr<TraceBuffer>> buffers;
+
+TraceBuffer* registerBuffer() {
+  std::lock_guard<std::mutex> lock(buffers_mutex);
+  buffers.push_back(std::make_unique<TraceBuffer>(buffers.size()));
+  return buffers.back().get();
+}
+
+thread_local TraceBuffer* my_buffer = nullptr;
+
+}
+
+void traceInitialize() {
+#ifdef PARTEXCHANGE_TRACE
+  // The calling thread runs the scheduler and becomes thread 0
+  if(my_buffer == nullptr)
+    my_buffer = registerBuffer();
+#endif
+  trace_start = TraceClock::now();
+}
+
+int64_t traceNow() {
+  return std::chrono::duration_cast<std::chrono::nanoseconds>(TraceClock::now() - trace_start).count();
+}
+
+void traceRecord(const TracePhase phase, const char* name, const int tile, const int peer, const int count, const long bytes) {
+  if(my_buffer == nullptr)
+    my_buffer = registerBuffer();
+
+  auto& event = my_buffer->events[my_buffer->next & (PARTEXCHANGE_TRACE_EVENTS - 1)];
+  event.ns = traceNow();
+  event.name = name;
+  event.phase = phase;
+  event.tile = tile;
+  event.peer = peer;
+  event.count = count;
+  event.bytes = bytes;
+
+  my_buffer->next++;
+}
+
+#ifdef PARTEXCHANGE_TRACE
+static void writeEvent(std::ostream& out, const TraceEvent& event, const int node, const int tid, bool& first) {
+  const double us = event.ns / 1e3;
+
+  if(!first)
+    out << ",\n";
+  first = false;
+
+  switch(event.phase) {
+    case TracePhase::Begin:
+      out << fmt::format("{{\"name\":\"{}\",\"ph\":\"B\",\"ts\":{:.3f},\"pid\":{},\"tid\":{},\"args\":{{\"tile\":{}}}}}",
+        event.name, us, node, tid, event.tile);
+      break;
+    case TracePhase::End:
+      out << fmt::format("{{\"name\":\"{}\",\"ph\":\"E\",\"ts\":{:.3f},\"pid\":{},\"tid\":{}}}",
+        event.name, us, node, tid);
+      break;
+    case TracePhase::Send:
+    case TracePhase::Recv:
+      out << fmt::format("{{\"name\":\"{}\",\"ph\":\"i\",\"s\":\"t\",\"ts\":{:.3f},\"pid\":{},\"tid\":{},"
+        "\"args\":{{\"tile\":{},\"peer\":{},\"count\":{},\"bytes\":{}}}}}",
+        event.name, us, node, tid, event.tile, event.peer, event.count, event.bytes);
+      break;
+  }
+}
+#endif
+
+void traceFinalize(const std::string& prefix, const int node) {
+#ifdef PARTEXCHANGE_TRACE
+  const std::string fname = fmt::format("{}.{}.json", prefix, node);
+  std::ofstream out(fname);
+  if(!out) {
+    std::cerr << "Could not open trace file " << fname << std::endl;
+    return;
+  }
+
+  std::lock_guard<std::mutex> lock(buffers_mutex);
+
+  out << "{\"displayTimeUnit\":\"ns\",\"traceEvents\":[\n";
+  bool first = true;
+
+  out << fmt::format("{{\"name\":\"process_name\",\"ph\":\"M\",\"pid\":{},\"args\":{{\"name\":\"Node {}\"}}}}", node, node);
+  first = false;
+
+  for(auto& buffer : buffers) {
+    out << fmt::format(",\n{{\"name\":\"thread_name\",\"ph\":\"M\",\"pid\":{},\"tid\":{},\"args\":{{\"name\":\"{}\"}}}}",
+      node, buffer->tid, buffer->tid == 0 ? "scheduler" : fmt::format("thread {}", buffer->tid));
+
+    // Oldest surviving event first
+    const uint64_t kept = std::min<uint64_t>(buffer->next, PARTEXCHANGE_TRACE_EVENTS);
+    for(uint64_t i = buffer->next - kept; i < buffer->next; i++)
+      writeEvent(out, buffer->events[i & (PARTEXCHANGE_TRACE_EVENTS - 1)], node, buffer->tid, first);
+  }
+
+  out << "\n]}\n";
+#endif
+}
@@ -0,0 +1,72 @@
+#ifndef TRACE_HPP
+#define TRACE_HPP
+#include <string>
+#include <chrono>
+#include <cstdint>
+
+// Hot path tracing, compiled in with PARTEXCHANGE_TRACE. Every thread
+// records into its own ring buffer, so recording takes no locks; only the
+// first event of a thread registers its buffer. When a buffer is full the
+// oldest events are overwritten. traceFinalize writes one Chrome trace
+// JSON per node, which scripts/merge_traces.py combines into one timeline.
+// Without PARTEXCHANGE_TRACE the macros compile to nothing
+
+// Events kept per thread, a power of two
+#ifndef PARTEXCHANGE_TRACE_EVENTS
+#define PARTEXCHANGE_TRACE_EVENTS (1 << 16)
+#endif
+
+enum class TracePhase : char { Begin = 'B', End = 'E', Send = 's', Recv = 'r' };
+
+struct TraceEvent {
+  int64_t ns;         // since traceInitialize
+  const char* name;   // string literal
+  TracePhase phase;
+  int tile;
+  int peer;           // tile (or node, for node batches) sent to or
+                      // received from, -1 if unknown
+  int count;          // particles
+  long bytes;
+};
+
+// Start the clock. Called on every node at the same time, so the per-node
+// traces line up to within a barrier's skew
+void traceInitialize();
+
+// Write prefix.<node>.json with the events of every thread
+void traceFinalize(const std::string& prefix, const int node);
+
+void traceRecord(const TracePhase phase, const char* name, const int tile, const int peer, const int count, const long bytes);
+
+// Nanoseconds since traceInitialize
+int64_t traceNow();
+
+// Begin and end events around a scope
+class TraceScope {
+  public:
+    TraceScope(const char* name_, const int tile_) : name(name_), tile(tile_) {
+      traceRecord(TracePhase::Begin, name, tile, -1, 0, 0);
+    }
+
+    ~TraceScope() {
+      traceRecord(TracePhase::End, name, tile, -1, 0, 0);
+    }
+
+  private:
+    const char* name;
+    int tile;
+};
+
+#ifdef PARTEXCHANGE_TRACE
+#define TRACE_CONCAT_IMPL(a, b) a##b
+#define TRACE_CONCAT(a, b) TRACE_CONCAT_IMPL(a, b)
+#define TRACE_SCOPE(name, tile) TraceScope TRACE_CONCAT(trace_scope_, __LINE__)(name, tile)
+#define TRACE_SEND(name, tile, peer, count, bytes) traceRecord(TracePhase::Send, name, tile, peer, count, bytes)
+#define TRACE_RECV(name, tile, peer, count, bytes) traceRecord(TracePhase::Recv, name, tile, peer, count, bytes)
+#else
+#define TRACE_SCOPE(name, tile) do {} while(0)
+#define TRACE_SEND(name, tile, peer, count, bytes) do {} while(0)
+#define TRACE_RECV(name, tile, peer, count, bytes) do {} while(0)
+#endif
+
+#endif
@@ -0,0 +1,159 @@
+#include "WorkModel.hpp"
+
+#include <chrono>
+#include <thread>
+#include <algorithm>
+#include <fmt/format.h>
+
+using WorkClock = std::chrono::steady_clock;
+
+// Results are written here so the kernels cannot be optimised away. One
+// per thread so concurrent move kernel chunks do not share it
+static thread_local volatile double work_sink = 0.;
+
+// Iterations of each calibration run; about 10 ms of work each
+static constexpr long calibration_iters = 1 << 22;
+
+// Words in each thread's stream buffer, 32 MB, so the Memory model streams
+// from DRAM both when calibrating and when running
+static constexpr std::size_t stream_words = (std::size_t(1) << 25) / sizeof(unsigned long);
+
+// Constructed and filled on a thread's first use. prepareThread() makes
+// that first use happen on every pool thread at startup, so no timed move
+// work pays for allocating and faulting in 32 MB
+struct StreamBuffer {
+  StreamBuffer() : words(stream_words, 1) {}
+
+  std::vector<unsigned long> words;
+  std::size_t next = 0;
+};
+
+static thread_local StreamBuffer stream_buffer;
+
+WorkModel* theWorkModel() {
+  static WorkModel model;
+  return &model;
+}
+
+void WorkModel::calibrate(const WorkModelType type_) {
+  type = type_;
+
+  if(type == WorkModelType::Spin) {
+    // Cost of the clock read that ends the spin
+    const auto begin = WorkClock::now();
+    for(long i = 0; i < calibration_iters; i++)
+      WorkClock::now();
+    const auto end = WorkClock::now();
+    spin_overhead_ns = std::chrono::duration<double, std::nano>(end - begin).count() / calibration_iters;
+  } else if(type == WorkModelType::Compute) {
+    // Opaque count so the timed loop is compiled like the one in run()
+    volatile long iters = calibration_iters;
+    work_sink = computeKernel(iters / 16); // Warm up
+    const auto begin = WorkClock::now();
+    work_sink = computeKernel(iters);
+    const auto end = WorkClock::now();
+    flops_per_ns = iters / std::chrono::duration<double, std::nano>(end - begin).count();
+  } else if(type == WorkModelType::Memory) {
+    // Stream the same buffer size the runtime kernel uses
+    const unsigned long nbytes = stream_words * sizeof(unsigned long);
+    work_sink = streamKernel(nbytes); // Warm up
+    const auto begin = WorkClock::now();
+    work_sink = streamKernel(4 * nbytes);
+    const auto end = WorkClock::now();
+    bytes_per_ns = (4. * nbytes) / std::chrono::duration<double, std::nano>(end - begin).count();
+  }
+}
+
+void WorkModel::prepareThread() {
+  if(type == WorkModelType::Memory)
+    work_sink = static_cast<double>(stream_buffer.words.size());
+}
+
+std::string WorkModel::describe() const {
+  switch(type) {
+    case WorkModelType::Spin:
+      return fmt::format("Spin, {:.1f} ns clock overhead", spin_overhead_ns);
+    case WorkModelType::Compute:
+      return fmt::format("Compute, {:.3f} FMA/ns", flops_per_ns);
+    case WorkModelType::Memory:
+      return fmt::format("Memory, {:.3f} bytes/ns", bytes_per_ns);
+    default:
+      return "Sleep";
+  }
+}
+
+void WorkModel::run(const unsigned long ns) {
+  if(ns == 0)
+    return;
+
+  switch(type) {
+    case WorkModelType::Spin:
+      spin(ns);
+      break;
+    case WorkModelType::Compute:
+      compute(ns);
+      break;
+    case WorkModelType::Memory:
+      stream(ns);
+      break;
+    default:
+      std::this_thread::sleep_for(std::chrono::nanoseconds(ns));
+      break;
+  }
+}
+
+void WorkModel::spin(const unsigned long ns) {
+  if(ns <= spin_overhead_ns)
+    return;
+
+  const auto deadline = WorkClock::now() + std::chrono::nanoseconds(static_cast<long>(ns - spin_overhead_ns));
+  while(WorkClock::now() < deadline) {}
+}
+
+void WorkModel::compute(const unsigned long ns) {
+  const long iters = static_cast<long>(ns * flops_per_ns);
+  if(iters > 0)
+    work_sink = computeKernel(iters);
+}
+
+double WorkModel::computeKernel(const long iters) {
+  // Four independent chains keep the FMA pipes busy without letting the
+  // compiler fold the loop
+  double a = 1.0, b = 1.1, c = 1.2, d = 1.3;
+  const double mul = 0.999999, add = 1e-6;
+  for(long i = 0; i < iters; i += 4) {
+    a = a * mul + add;
+    b = b * mul + add;
+    c = c * mul + add;
+    d = d * mul + add;
+  }
+  return a + b + c + d;
+}
+
+void WorkModel::stream(const unsigned long ns) {
+  const unsigned long nbytes = static_cast<unsigned long>(ns * bytes_per_ns);
+  if(nbytes > 0)
+    work_sink = streamKernel(nbytes);
+}
+
+unsigned long WorkModel::streamKernel(const unsigned long nbytes) {
+  auto& buf = stream_buffer;
+  const unsigned long* words = buf.words.data();
+
+  // Whole words only, so the bytes counted are the bytes read
+  unsigned long remaining = nbytes / sizeof(unsigned long);
+  unsigned long sum = 0;
+
+  while(remaining > 0) {
+    const std::size_t count = std::min<unsigned long>(remaining, stream_words - buf.next);
+    for(std::size_t w = buf.next; w < buf.next + count; w++)
+      sum += words[w];
+
+    remaining -= count;
+    buf.next += count;
+    if(buf.next == stream_words)
+      buf.next = 0;
+  }
+
+  return sum;
+}
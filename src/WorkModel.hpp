@@ -0,0 +1,56 @@
+#ifndef WORK_MODEL_HPP
+#define WORK_MODEL_HPP
+#include <vector>
+#include <string>
+
+// What a particle move costs
+// Sleep: sleep for the time, frees the core (original behaviour)
+// Spin: busy wait on the steady clock
+// Compute: dependent floating point multiply-adds
+// Memory: stream reads over a per-thread buffer larger than cache
+enum class WorkModelType { Sleep, Spin, Compute, Memory };
+
+// Turns "N nanoseconds of move work" into real core occupancy. The
+// Compute and Memory models are calibrated once at startup by timing
+// their kernels, so a request for N ns runs for about N ns. The Memory
+// model streams the same size of buffer at runtime as it was calibrated
+// on, so its bandwidth is the one that was measured
+class WorkModel {
+  public:
+    WorkModel() = default;
+
+    void calibrate(const WorkModelType type_);
+
+    // Set up the calling thread's state for run(), so it is not done
+    // inside timed work. Call once on every thread that will run work
+    void prepareThread();
+
+    // Spend roughly ns nanoseconds working
+    void run(const unsigned long ns);
+
+    WorkModelType getType() const { return type; }
+
+    // Human readable calibration result
+    std::string describe() const;
+
+  private:
+    void spin(const unsigned long ns);
+    void compute(const unsigned long ns);
+    void stream(const unsigned long ns);
+
+    // Run the compute kernel for a fixed number of iterations
+    double computeKernel(const long iters);
+
+    // Read nbytes from this thread's stream buffer, carrying on from where
+    // the thread's last call stopped. Returns the sum of the words read
+    unsigned long streamKernel(const unsigned long nbytes);
+
+    WorkModelType type = WorkModelType::Sleep;
+    double spin_overhead_ns = 0.;
+    double flops_per_ns = 0.;
+    double bytes_per_ns = 0.;
+};
+
+WorkModel* theWorkModel();
+
+#endif
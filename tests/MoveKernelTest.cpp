@@ -0,0 +1,129 @@
+// Checks the closed-form move kernel against the move loop. Both kernels
+// run over the same particles, crossing counts and counter RNG key, which
+// gives two independent samples of the same distributions: the moves each
+// particle makes and whether it migrates. Their means have to agree to
+// within a few standard errors of the difference, both for the first hop
+// of every particle and for the next hop of the ones that migrated
+#include "MoveKernels.hpp"
+
+#include <vector>
+#include <cmath>
+#include <algorithm>
+#include <cstdio>
+
+struct PassResult {
+  int count = 0;          // particles moved in the pass
+  double mean_moves = 0.;
+  double var_moves = 0.;
+  double migrated = 0.;   // fraction of particles
+};
+
+static constexpr int num_particles = 1 << 18;
+static constexpr int num_neighbours = 6;
+static constexpr double ave_crossings = 4.;
+static constexpr double tolerance_sigmas = 5.;
+
+// Run one kernel over the given particles. The ids and moves left of the
+// particles that migrate are returned in next_ids and next_moves, as they
+// would arrive at the neighbouring tile
+static PassResult runPass(const bool closed_form, const int migrate_chance, const CounterKey& key,
+  std::vector<int>& ids, std::vector<int>& num_moves, std::vector<int>& next_ids, std::vector<int>& next_moves) {
+  const int count = static_cast<int>(ids.size());
+  std::vector<int> deads(count, 0);
+  const ParticleColumns cols = {ids.data(), num_moves.data(), deads.data(), 1};
+  const std::vector<int> before = num_moves;
+
+  std::vector<int> migrant_idx(count + simd_slack), migrant_neigh(count + simd_slack);
+  int num_migrants = 0;
+  if(closed_form)
+    counterMoveRangeClosedForm(cols, 0, count, key, migrateLogStay(migrate_chance), num_neighbours,
+      migrant_idx.data(), migrant_neigh.data(), num_migrants);
+  else
+    counterMoveRange(cols, 0, count, key, migrate_chance, num_neighbours,
+      migrant_idx.data(), migrant_neigh.data(), num_migrants);
+
+  PassResult result;
+  result.count = count;
+  if(count == 0)
+    return result;
+
+  for(int i = 0; i < count; i++)
+    result.mean_moves += before[i] - num_moves[i];
+  result.mean_moves /= count;
+
+  for(int i = 0; i < count; i++) {
+    const double d = before[i] - num_moves[i] - result.mean_moves;
+    result.var_moves += d * d;
+  }
+  result.var_moves /= std::max(count - 1, 1);
+  result.migrated = static_cast<double>(num_migrants) / count;
+
+  next_ids.clear();
+  next_moves.clear();
+  for(int m = 0; m < num_migrants; m++) {
+    next_ids.push_back(ids[migrant_idx[m]]);
+    next_moves.push_back(num_moves[migrant_idx[m]]);
+  }
+
+  return result;
+}
+
+// Two passes of one kernel in the same step: every particle, then the
+// particles that migrated in the first pass, with the moves they had left.
+// The second pass draws for particles the first already drew for, so it
+// checks the kernel does not reuse those draws
+static std::vector<PassResult> runKernel(const bool closed_form, const int migrate_chance, const CounterKey& key) {
+  std::vector<int> ids(num_particles), num_moves(num_particles);
+  for(int i = 0; i < num_particles; i++)
+    ids[i] = i;
+
+  std::vector<int> deads(num_particles, 0);
+  const ParticleColumns cols = {ids.data(), num_moves.data(), deads.data(), 1};
+  counterSetMoves(cols, 0, num_particles, key, PoissonTable(ave_crossings));
+
+  std::vector<int> hop_ids, hop_moves, unused_ids, unused_moves;
+  std::vector<PassResult> results;
+  results.push_back(runPass(closed_form, migrate_chance, key, ids, num_moves, hop_ids, hop_moves));
+  results.push_back(runPass(closed_form, migrate_chance, key, hop_ids, hop_moves, unused_ids, unused_moves));
+  return results;
+}
+
+// Whether two sample means, over the given numbers of samples with the
+// given variances, agree
+static bool agree(const char* what, const int migrate_chance, const int pass, const double a, const double b,
+  const double var_a, const double var_b, const int n_a, const int n_b) {
+  if(n_a == 0 || n_b == 0) {
+    const bool ok = (n_a == n_b);
+    std::printf("Migration chance %3d pass %d: %s %s\n", migrate_chance, pass, what, ok ? "no particles, ok" : "only one kernel has particles, FAILED");
+    return ok;
+  }
+
+  const double sigma = std::sqrt(var_a / n_a + var_b / n_b);
+  const bool ok = std::abs(a - b) <= tolerance_sigmas * sigma + 1e-12;
+
+  std::printf("Migration chance %3d pass %d: %s loop %.5f closed form %.5f (%.1f sigma) %s\n",
+    migrate_chance, pass, what, a, b, sigma > 0. ? std::abs(a - b) / sigma : 0., ok ? "ok" : "FAILED");
+  return ok;
+}
+
+int main() {
+  std::printf("Move kernels: %s\n", moveKernelISA());
+
+  const CounterKey key = {1234567u, 8u};
+  bool ok = true;
+
+  for(const int migrate_chance : {0, 5, 10, 30, 60, 100}) {
+    const auto loop = runKernel(false, migrate_chance, key);
+    const auto closed = runKernel(true, migrate_chance, key);
+
+    for(std::size_t pass = 0; pass < loop.size(); pass++) {
+      const auto& l = loop[pass];
+      const auto& c = closed[pass];
+      ok &= agree("moves per particle", migrate_chance, static_cast<int>(pass) + 1, l.mean_moves, c.mean_moves, l.var_moves, c.var_moves, l.count, c.count);
+      ok &= agree("migrated fraction ", migrate_chance, static_cast<int>(pass) + 1, l.migrated, c.migrated,
+        l.migrated * (1. - l.migrated), c.migrated * (1. - c.migrated), l.count, c.count);
+    }
+  }
+
+  return ok ? 0 : 1;
+}